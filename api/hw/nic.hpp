@@ -80,9 +80,16 @@ namespace hw {
     inline size_t buffers_available()
     { return bufstore().buffers_available(); }
 
+    /** Whether the device finishes partial transport checksums */
+    inline bool checksum_offload() const noexcept
+    { return driver_.checksum_offload(); }
+
     inline void on_exit_to_physical(delegate<void(net::Packet_ptr)> dlg)
     { driver_.on_exit_to_physical(dlg); }
 
+    inline void on_receive_done(delegate<void()> dlg)
+    { driver_.on_receive_done(dlg); }
+
   private:
     driver_t driver_;
 
@@ -0,0 +1,74 @@
+// This file is a part of the IncludeOS unikernel - www.includeos.org
+//
+// Copyright 2015 Oslo and Akershus University College of Applied Sciences
+// and Alfred Bratterud
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+//     http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KERNEL_ENTROPY_HPP
+#define KERNEL_ENTROPY_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ *  Unpredictable numbers for the kernel and the network stack
+ *
+ *  A ChaCha20 keystream, keyed from RDRAND on first use. Blocks are made
+ *  a batch at a time. The last 32 bytes of every batch become the next
+ *  key, so the key that made earlier output is gone, and the rest is
+ *  handed out a word at a time. Most calls are an array read.
+ *
+ *  Without RDRAND the key comes from the TSC and rand(), which is
+ *  guessable: good enough against blind attackers, not for secrets.
+ */
+class Entropy {
+public:
+  /** 32 random bits */
+  static uint32_t random32() noexcept {
+    if (avail_ == 0)
+      refill();
+    const uint32_t r = pool_[--avail_];
+    pool_[avail_] = 0;
+    return r;
+  }
+
+  /** 64 random bits */
+  static uint64_t random64() noexcept {
+    const uint64_t hi = random32();
+    return (hi << 32) | random32();
+  }
+
+  /** Fill @n bytes at @buf */
+  static void fill(void* buf, size_t n) noexcept;
+
+  /** Whether the key came from RDRAND */
+  static bool hardware_seeded() noexcept
+  { return hardware_; }
+
+private:
+  static constexpr unsigned blocks = 4;
+  static constexpr unsigned key_words = 8;
+
+  static uint32_t key_[key_words];
+  static uint32_t pool_[blocks * 16];
+  static uint64_t counter_;
+  static unsigned avail_;
+  static bool seeded_;
+  static bool hardware_;
+
+  static void seed() noexcept;
+  static void refill() noexcept;
+}; //< class Entropy
+
+#endif //< KERNEL_ENTROPY_HPP
@@ -0,0 +1,221 @@
+// This file is a part of the IncludeOS unikernel - www.includeos.org
+//
+// Copyright 2015 Oslo and Akershus University College of Applied Sciences
+// and Alfred Bratterud
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef NET_CONNECTION_TABLE_HPP
+#define NET_CONNECTION_TABLE_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+#include <utility>
+#include <kernel/entropy.hpp>
+#include <utility/siphash.hpp>
+
+namespace net {
+
+  /**
+   *  Connections, keyed on {local port, remote socket}
+   *
+   *  Open addressing with linear probing, hashed with a keyed hash
+   *  (HalfSipHash) keyed from Entropy, so remote peers can't aim for
+   *  long probe sequences.
+   *
+   *  Growing is incremental: a new table is allocated, and every
+   *  operation moves a few slots over from the old one. Lookups check
+   *  both tables until the old one is empty, so there's never a pause
+   *  to rehash everything at once.
+   *
+   *  @note Pointers to values are only valid until the next emplace or erase.
+   */
+  template <typename Tuple, typename T>
+  class Connection_table {
+  public:
+    explicit Connection_table(size_t size = 64)
+      : table_(size)
+    {
+      Entropy::fill(key_, sizeof(key_));
+    }
+
+    /** The value for @tuple, or nullptr */
+    T* find(const Tuple& tuple) {
+      const uint32_t h = hash(tuple);
+      if (auto* s = find_in(table_, tuple, h))
+        return &s->value;
+      if (migrating())
+        if (auto* s = find_in(old_, tuple, h))
+          return &s->value;
+      return nullptr;
+    }
+
+    /** Insert unless present. @return the value, and whether it was inserted */
+    std::pair<T*, bool> emplace(const Tuple& tuple, T value) {
+      if (auto* existing = find(tuple))
+        return {existing, false};
+
+      migrate_some();
+
+      if ((used_ + deleted_ + 1) * 4 > table_.size() * 3)
+        grow();
+
+      auto& s = free_slot(table_, hash(tuple));
+      if (s.state == DELETED) deleted_--;
+      s.state = USED;
+      s.tuple = tuple;
+      s.value = std::move(value);
+      used_++;
+      return {&s.value, true};
+    }
+
+    /** Remove @tuple. @return whether it was there */
+    bool erase(const Tuple& tuple) {
+      const uint32_t h = hash(tuple);
+      bool found = false;
+
+      if (auto* s = find_in(table_, tuple, h)) {
+        release(*s);
+        used_--;
+        deleted_++;
+        found = true;
+      }
+      else if (migrating()) {
+        if (auto* s = find_in(old_, tuple, h)) {
+          release(*s);
+          old_used_--;
+          found = true;
+        }
+      }
+
+      migrate_some();
+      return found;
+    }
+
+    size_t size() const noexcept
+    { return used_ + old_used_; }
+
+    size_t capacity() const noexcept
+    { return table_.size(); }
+
+    bool migrating() const noexcept
+    { return not old_.empty(); }
+
+    /** Call @func(tuple, value) for every entry */
+    template <typename Func>
+    void for_each(Func func) const {
+      for (auto& s : table_)
+        if (s.state == USED) func(s.tuple, s.value);
+      for (auto& s : old_)
+        if (s.state == USED) func(s.tuple, s.value);
+    }
+
+  private:
+    enum State : uint8_t { FREE, USED, DELETED };
+
+    struct slot {
+      Tuple   tuple {};
+      T       value {};
+      State   state {FREE};
+    };
+
+    using Table = std::vector<slot>;
+
+    /** Old slots moved per operation, while growing */
+    static constexpr size_t migrate_step = 8;
+
+    Table    table_;
+    Table    old_;
+    size_t   used_      {0};
+    size_t   deleted_   {0};
+    size_t   old_used_  {0};
+    size_t   old_pos_   {0};
+    uint32_t key_[2];
+
+    uint32_t hash(const Tuple& tuple) const noexcept {
+      const uint32_t words[2] {
+        tuple.second.address().whole,
+        static_cast<uint32_t>(tuple.first) << 16 | tuple.second.port()
+      };
+      return HalfSipHash::hash(key_, words, 2);
+    }
+
+    static slot* find_in(Table& table, const Tuple& tuple, uint32_t h) {
+      const size_t mask = table.size() - 1;
+      for (size_t i = h & mask;; i = (i + 1) & mask) {
+        auto& s = table[i];
+        if (s.state == FREE)
+          return nullptr;
+        if (s.state == USED and s.tuple == tuple)
+          return &s;
+      }
+    }
+
+    static slot& free_slot(Table& table, uint32_t h) {
+      const size_t mask = table.size() - 1;
+      size_t i = h & mask;
+      while (table[i].state == USED)
+        i = (i + 1) & mask;
+      return table[i];
+    }
+
+    static void release(slot& s) {
+      s.state = DELETED;
+      s.value = T{};
+    }
+
+    /** Start moving everything to a new table */
+    void grow() {
+      // The previous move must be done first. It almost always is,
+      // since every operation moves a few slots.
+      while (migrating())
+        migrate_some();
+
+      const size_t size = (used_ * 2 >= table_.size()) ? table_.size() * 2 : table_.size();
+
+      old_.swap(table_);
+      table_    = Table(size);
+      old_used_ = used_;
+      old_pos_  = 0;
+      used_     = 0;
+      deleted_  = 0;
+    }
+
+    void migrate_some() {
+      if (not migrating()) return;
+
+      const size_t end = std::min(old_pos_ + migrate_step, old_.size());
+
+      for (; old_pos_ < end; old_pos_++) {
+        auto& s = old_[old_pos_];
+        if (s.state != USED) continue;
+
+        auto& dst = free_slot(table_, hash(s.tuple));
+        if (dst.state == DELETED) deleted_--;
+        dst.state = USED;
+        dst.tuple = s.tuple;
+        dst.value = std::move(s.value);
+        s.state = DELETED;
+        used_++;
+        old_used_--;
+      }
+
+      if (old_pos_ == old_.size())
+        Table().swap(old_);
+    }
+  }; //< class Connection_table
+
+} //< namespace net
+
+#endif //< NET_CONNECTION_TABLE_HPP
@@ -50,6 +50,7 @@
  **/
 
 #include <net/ip4/ip4.hpp> // IP4::addr
+#include <kernel/entropy.hpp>
 #include <string>
 #include <vector>
 #include <functional>
@@ -182,10 +183,10 @@ namespace net
         std::string readName(const char* reader, const char* buffer, int& count);
       };
       
+      // unguessable, so spoofed answers have to hit 1 in 65536
       unsigned short generateID()
       {
-        static unsigned short id = 0;
-        return ++id;
+        return Entropy::random32();
       }
       void dnsNameFormat(char* dns);
       
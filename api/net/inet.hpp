@@ -67,6 +67,9 @@ namespace net {
     /** Number of buffers available in the bufstore */
     virtual size_t buffers_available() = 0;
 
+    /** Whether the NIC can finish transport checksums for us */
+    virtual bool checksum_offload() = 0;
+
   }; //< class Inet<LINKLAYER, IPV>
 } //< namespace net
 
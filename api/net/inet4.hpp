@@ -127,6 +127,10 @@ namespace net {
       this->netmask_   = nmask;
       this->router_    = router;
       this->dns_server = dns;
+
+      // Let the neighbors know (and update their caches)
+      if (addr != IP4::INADDR_ANY)
+        arp_.announce();
     }
 
     // register a callback for receiving signal on free packet-buffers
@@ -143,6 +147,10 @@ namespace net {
       return nic_.buffers_available();
     }
 
+    virtual bool checksum_offload() override {
+      return nic_.checksum_offload();
+    }
+
   private:
     inline void process_sendq(size_t);
     // delegates registered to get signalled about free packets
@@ -20,7 +20,8 @@
 #define NET_IP4_ARP_HPP
 
 #include <os>
-#include <map>
+#include <array>
+#include <vector>
 
 #include <delegate>
 #include "ip4.hpp"
@@ -34,26 +35,64 @@ namespace net {
   private:
     /** ARP cache expires after cache_exp_t_ seconds */
     static constexpr uint16_t cache_exp_t_ {60 * 60 * 12};
-  
-    /** Cache entries are just MAC's and timestamps */
-    struct cache_entry {
+
+    /** Confirmed neighbors go stale after reachable_t_ seconds */
+    static constexpr uint16_t reachable_t_ {30};
+
+    /** Seconds before the first retransmit of a request. Doubles per retry */
+    static constexpr double   retry_t_     {1.0};
+
+    /** Requests sent before an unresolved or probed neighbor is given up */
+    static constexpr uint8_t  max_retries_ {3};
+
+    /** Packets held per unresolved neighbor. The oldest is dropped on overflow */
+    static constexpr uint8_t  max_pending_ {4};
+
+    /** Initial size of the neighbor table (power of two) */
+    static constexpr size_t   table_size_  {32};
+
+    /** Neighbor reachability, loosely after RFC 4861 7.3.2 */
+    enum class State : uint8_t {
+      FREE,       //< Slot never used
+      DELETED,    //< Tombstone, keeps probe sequences intact
+      INCOMPLETE, //< Request sent, no MAC yet
+      REACHABLE,  //< Recently confirmed by the neighbor
+      STALE,      //< MAC is usable, but hasn't been confirmed lately
+      PROBE       //< Unicast request sent to re-confirm a stale MAC
+    };
+
+    /**
+     *  A slot in the neighbor table
+     *
+     *  Kept small, so that a probe sequence touches as few cache lines as possible.
+     *  The pending packets live in a parallel table with the same indexing.
+     */
+    struct neighbor {
+      IP4::addr      ip_;
       Ethernet::addr mac_;
-      uint64_t       timestamp_;
-    
-      /** Map needs empty constructor (we have no emplace yet) */
-      cache_entry() noexcept = default;
-    
-      cache_entry(Ethernet::addr mac) noexcept
-      : mac_(mac), timestamp_(OS::uptime()) {}
-    
-      cache_entry(const cache_entry& cpy) noexcept
-      : mac_(cpy.mac_), timestamp_(cpy.timestamp_) {}
-    
-      void update() noexcept { timestamp_ = OS::uptime(); }
-    }; //< struct cache_entry
-  
-    using Cache       = std::map<IP4::addr, cache_entry>;
-    using PacketQueue = std::map<IP4::addr, Packet_ptr>;
+      State          state_;
+      uint8_t        retries_;
+      uint8_t        pending_head_;
+      uint8_t        pending_count_;
+      uint16_t       generation_; //< Of the retry timers, see Arp::generation_
+      uint32_t       timestamp_;
+
+      bool in_use() const noexcept
+      { return state_ > State::DELETED; }
+
+      bool has_mac() const noexcept
+      { return state_ > State::INCOMPLETE; }
+
+      void update(Ethernet::addr mac) noexcept {
+        mac_       = mac;
+        state_     = State::REACHABLE;
+        retries_   = 0;
+        timestamp_ = OS::uptime();
+      }
+    }; //< struct neighbor
+
+    using Table       = std::vector<neighbor>;
+    using PacketQueue = std::array<Packet_ptr, max_pending_>;
   public:
     /**
      *  You can assign your own ARP-resolution delegate
@@ -110,43 +149,80 @@ namespace net {
   
     /** Downstream transmission. */
     void transmit(Packet_ptr);
+
+    /** Announce our own IP-address, i.e. after it changed (gratuitous ARP) */
+    void announce();
+
+    /** Number of neighbors in the table */
+    size_t neighbors() const noexcept
+    { return used_; }
   
-  private: 
+  private:
     Inet<Ethernet, IP4>& inet_;
-  
+
     /** Needs to know which mac address to put in header->swhaddr */
     Ethernet::addr mac_;
-  
+
     /** Outbound data goes through here */
     downstream linklayer_out_;
-  
-    /** The ARP cache */
-    Cache cache_;
-  
-    /** Cache IP resolution. */
-    void cache(IP4::addr, Ethernet::addr);
-  
-    /** Check if an IP is cached and not expired */
-    bool is_valid_cached(IP4::addr);
-  
-    /** ARP resolution. */
-    Ethernet::addr resolve(IP4::addr);
-  
-    void arp_respond(header* hdr_in);    
-  
+
+    /** The neighbor table (open addressing, linear probing) */
+    Table neighbors_;
+
+    /** Packets waiting for resolution, indexed like neighbors_ */
+    std::vector<PacketQueue> pending_;
+
+    /** Slots in use, and tombstones */
+    size_t used_ {0};
+    size_t deleted_ {0};
+
+    /** Bumped for every new run of retries, so a timer from an old one can tell */
+    uint16_t generation_ {0};
+
+    /** Slot for an IP, if it's in the table */
+    neighbor* find(IP4::addr);
+
+    /** Find the slot for an IP, expiring and aging it on the way */
+    neighbor* lookup(IP4::addr);
+
+    /** Claim a new slot for an IP. The IP must not already be in the table */
+    neighbor& insert(IP4::addr);
+
+    /** Release a slot, dropping any packets waiting on it */
+    void erase(neighbor&);
+
+    /** Grow the table, or just clean out tombstones */
+    void rehash(size_t size);
+
+    inline size_t index_of(const neighbor& n) const noexcept
+    { return &n - neighbors_.data(); }
+
+    inline size_t home_slot(IP4::addr ip) const noexcept
+    { return (ip.whole * 2654435769u) & (neighbors_.size() - 1); }
+
+    /** Queue a packet on an unresolved neighbor */
+    void await_resolution(neighbor&, Packet_ptr);
+
+    /** Send everything that was waiting for a neighbor */
+    void flush_pending(neighbor&);
+
+    /** Send an ARP request for an IP to the given MAC */
+    void send_request(IP4::addr, Ethernet::addr);
+
+    /** Start unicast re-confirmation of a stale neighbor */
+    void start_probe(neighbor&);
+
+    /** Retransmit timer for INCOMPLETE / PROBE neighbors */
+    void schedule_retry(const neighbor&);
+    void retry(IP4::addr, uint16_t generation);
+
+    void arp_respond(header* hdr_in);
+
     // two different ARP resolvers
     void arp_resolve(Packet_ptr);
     void hh_map(Packet_ptr);
-  
+
     Arp_resolver arp_resolver_ = Arp_resolver::from<Arp, &Arp::arp_resolve>(*this);
-  
-    PacketQueue waiting_packets_;
-  
-    /** Add a packet to waiting queue, to be sent when IP is resolved */
-    void await_resolution(Packet_ptr, IP4::addr);
-  
-    /** Create a default initialized ARP-packet */
-    Packet_ptr createPacket();
   }; //< class Arp
 
 } //< namespace net
@@ -48,6 +48,26 @@ namespace net {
   
     uint8_t protocol() const noexcept
     { return ip4_header().protocol; }
+
+    /** The ECN field, the low two bits of the TOS byte [RFC 3168] */
+    enum ECN : uint8_t {
+      NOT_ECT = 0x0,
+      ECT1    = 0x1,
+      ECT0    = 0x2,
+      CE      = 0x3  // Congestion Experienced
+    };
+
+    ECN ecn() const noexcept
+    { return static_cast<ECN>(ip4_header().tos & 0x3); }
+
+    void set_ecn(ECN ecn) noexcept
+    { ip4_header().tos = (ip4_header().tos & ~0x3) | ecn; }
+
+    uint8_t tos() const noexcept
+    { return ip4_header().tos; }
+
+    void set_tos(uint8_t tos) noexcept
+    { ip4_header().tos = tos; }
   
     uint16_t ip4_segment_size() const noexcept
     { return ntohs(ip4_header().tot_len); }
@@ -73,6 +73,11 @@ namespace net
     {
       return (char*) (buffer() + sizeof(UDP::full_header));
     }
+    //! the payload as a span, i.e. for filling in place
+    inline gsl::span<uint8_t> data_span()
+    {
+      return gsl::span<uint8_t>((uint8_t*) data(), data_length());
+    }
     
     // sets the correct length for all the protocols up to IP4
     void set_length(uint16_t newlen)
@@ -86,6 +91,14 @@ namespace net
     
     // generates a new checksum and sets it for this UDP packet
     uint16_t gen_checksum();
+
+    // leaves the checksum for the NIC to finish, with the
+    // pseudo header sum in place (checksum offload)
+    void offload_checksum();
+
+    // verifies the checksum of a received packet (RFC 768)
+    // a zero checksum means the sender didn't generate one
+    bool checksum_ok() const;
     
     //! assuming the packet has been properly initialized,
     //! this will fill bytes from @buffer into this packets buffer,
@@ -100,5 +113,9 @@ namespace net
       set_length(data_length() + total);
       return total;
     }
+
+  private:
+    // unfolded sum of the RFC 768 pseudo header
+    uint32_t pseudo_sum() const;
   };
 }
@@ -18,9 +18,12 @@
 #ifndef NET_IP4_UDP_HPP
 #define NET_IP4_UDP_HPP
 
+#include <common>
 #include <deque>
-#include <map>
+#include <memory>
+#include <vector>
 #include "../inet.hpp"
+#include "../port_util.hpp"
 #include "ip4.hpp"
 #include <cstring>
 
@@ -40,12 +43,26 @@ namespace net {
 
     typedef delegate<void()> sendto_handler;
 
+    // a piece of a message, for scatter/gather sends
+    struct fragment
+    {
+      const void* data;
+      size_t      length;
+    };
+    using fragments = gsl::span<const fragment>;
+
     // write buffer for sendq
     struct WriteBuffer
     {
+      // gathers a copy of @frags, to be split into datagrams as
+      // transmit queue space becomes available
       WriteBuffer(
-                  const uint8_t* data, size_t length, sendto_handler cb,
-                  UDP& udp, addr_t LA, port_t LP, addr_t DA, port_t DP);
+                  fragments frags, size_t length, sendto_handler cb,
+                  UDP& udp, addr_t LA, port_t LP, addr_t DA, port_t DP,
+                  bool csum = true);
+
+      // a ready datagram in a NIC buffer, waiting for transmit queue space
+      WriteBuffer(Packet_ptr datagram, sendto_handler cb, UDP& udp);
 
       int remaining() const {
         return len - offset;
@@ -55,10 +72,15 @@ namespace net {
       }
 
       size_t packets_needed() const;
-      void write();
+
+      // create and transmit at most @num datagrams,
+      // returns the number transmitted
+      size_t write(size_t num);
 
       // buffer, total length and current write offset
       std::shared_ptr<uint8_t> buf;
+      // or, a ready datagram
+      Packet_ptr datagram;
       size_t len;
       size_t offset;
       // the callback for when this buffer is written
@@ -72,8 +94,16 @@ namespace net {
       // destination address and port
       port_t d_port;
       addr_t d_addr;
+      // generate checksums for the datagrams
+      bool checksum;
     };
 
+    //! number of datagrams needed for a message of @length bytes
+    size_t datagrams_needed(size_t length) noexcept
+    {
+      return (length + max_datagram_size() - 1) / max_datagram_size();
+    }
+
     /** UDP header */
     struct udp_header {
       port_t   sport;
@@ -128,19 +158,39 @@ namespace net {
     // create and transmit @num packets from sendq
     void process_sendq(size_t num);
 
+    // hand batched datagrams to sockets in batch receive mode
+    void deliver_batches();
+
     inline constexpr uint16_t max_datagram_size() noexcept {
       return stack().ip_obj().MDDS() - sizeof(udp_header);
     }
 
+    //! set the checksum of an outgoing packet, or let the NIC do it
+    void checksum(PacketUDP&);
+
+    //! datagrams dropped because of a bad checksum
+    uint32_t checksum_errors() const noexcept
+    { return checksum_errors_; }
+
+    //! datagrams dropped because the length didn't add up
+    uint32_t length_errors() const noexcept
+    { return length_errors_; }
+
   private:
 
     downstream  network_layer_out_;
     Stack&      stack_;
-    std::map<port_t, UDPSocket> ports_;
-    port_t      current_port_ {1024};
+    // bound sockets, indexed by port
+    std::vector<std::unique_ptr<UDPSocket>> ports_;
+    Port_util   bound_ports_;
+
+    uint32_t    checksum_errors_ {0};
+    uint32_t    length_errors_   {0};
 
     // the async send queue
     std::deque<WriteBuffer> sendq;
+    // sockets with a batch of datagrams waiting to be delivered
+    std::vector<UDPSocket*> batches_pending_;
     friend class net::UDPSocket;
   }; //< class UDP
 
@@ -20,6 +20,7 @@
 #define NET_IP4_UDP_SOCKET_HPP
 #include "udp.hpp"
 #include <string>
+#include <vector>
 
 namespace net
 {
@@ -32,6 +33,52 @@ namespace net
 
     typedef delegate<void(addr_t, port_t, const char*, size_t)> recvfrom_handler;
     typedef UDP::sendto_handler sendto_handler;
+    typedef UDP::fragment fragment;
+    typedef UDP::fragments fragments;
+
+    // a received datagram, still in its NIC buffer.
+    // the buffer is kept for as long as the view is
+    class datagram
+    {
+    public:
+      datagram(UDP::Packet_ptr p)
+        : pckt(std::move(p)) {}
+
+      addr_t src() const
+      {
+        return pckt->src();
+      }
+      port_t src_port() const
+      {
+        return pckt->src_port();
+      }
+      const char* data() const
+      {
+        return pckt->data();
+      }
+      size_t size() const
+      {
+        return pckt->data_length();
+      }
+      gsl::span<const uint8_t> span() const
+      {
+        return gsl::span<const uint8_t>((const uint8_t*) data(), size());
+      }
+      // give the buffer back to the NIC
+      void release()
+      {
+        pckt = nullptr;
+      }
+      explicit operator bool() const
+      {
+        return pckt != nullptr;
+      }
+
+    private:
+      UDP::Packet_ptr pckt;
+    };
+    typedef gsl::span<datagram> datagrams;
+    typedef delegate<void(datagrams)> batch_handler;
 
     // constructors
     UDPSocket(UDP&, port_t port);
@@ -46,12 +93,30 @@ namespace net
     {
       on_read_handler = callback;
     }
+    // batch receive (like recvmmsg): datagrams are collected and delivered
+    // together at the end of each receive burst, or when @max_batch is reached.
+    // move views out of the span to keep them, the rest are released after
+    // the handler returns
+    void on_read_batch(batch_handler callback, size_t max_batch = 32);
     void sendto(addr_t destIP, port_t port,
                 const void* buffer, size_t length,
                 sendto_handler cb = [] {});
+    // scatter/gather: the fragments make up one message,
+    // copied straight into NIC buffers when there's room to send it
+    void sendto(addr_t destIP, port_t port,
+                fragments frags,
+                sendto_handler cb = [] {});
     void bcast(addr_t srcIP, port_t port,
                const void* buffer, size_t length,
                sendto_handler cb = [] {});
+
+    // zero-copy: a datagram in a NIC buffer, with room for
+    // max_datagram_size() bytes. fill data_span() in place, then
+    // send it with sendto(), giving the number of bytes written
+    UDP::Packet_ptr create_packet();
+    void sendto(addr_t destIP, port_t port,
+                UDP::Packet_ptr datagram, size_t length,
+                sendto_handler cb = [] {});
     void close();
 
     void join(multicast_group_addr);
@@ -67,17 +132,35 @@ namespace net
       return l_port;
     }
 
+    // checksums are on by default. Turning them off skips both
+    // generation and validation, and is meant for trusted links only
+    void set_checksum(bool enabled)
+    {
+      checksum = enabled;
+    }
+    bool checksum_enabled() const
+    {
+      return checksum;
+    }
+
   private:
     void packet_init(UDP::Packet_ptr, addr_t, addr_t, port_t, uint16_t);
+    void send(addr_t, addr_t, port_t, fragments, sendto_handler);
+    void deliver_batch();
     void internal_read(UDP::Packet_ptr);
 
     UDP& udp;
     port_t l_port;
     recvfrom_handler on_read_handler =
       [] (addr_t, port_t, const char*, size_t) {};
+    batch_handler on_batch_handler;
+    std::vector<datagram> batch;
+    size_t max_batch = 0;
+    bool batch_queued = false; // waiting for UDP::deliver_batches
 
     bool reuse_addr;
     bool loopback; // true means multicast data is looped back to sender
+    bool checksum = true;
 
     friend class UDP;
     friend class std::allocator<UDPSocket>;
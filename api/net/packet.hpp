@@ -105,6 +105,25 @@ namespace net {
     inline BufferStore::buffer_t payload() const noexcept
     { return payload_; }
 
+    /**
+     *  Leave the transport checksum for the NIC to finish (checksum offload)
+     *
+     *  @param start:  Where the NIC starts summing, from the start of the buffer
+     *  @param offset: Where the NIC puts the sum, relative to start
+     */
+    inline void set_checksum_offload(uint16_t start, uint16_t offset) noexcept
+    { csum_start_ = start; csum_offset_ = offset; }
+
+    /** Does the NIC need to finish the checksum */
+    inline bool checksum_offload() const noexcept
+    { return csum_offset_ != 0; }
+
+    inline uint16_t csum_start() const noexcept
+    { return csum_start_; }
+
+    inline uint16_t csum_offset() const noexcept
+    { return csum_offset_; }
+
     /**
      *  Upcast back to normal packet
      *
@@ -129,6 +148,10 @@ namespace net {
     Packet_ptr chain_ {0};
     Packet_ptr last_ {0};
 
+    /** Partial checksum, for the NIC to finish */
+    uint16_t csum_start_  {0};
+    uint16_t csum_offset_ {0};
+
     /** Default constructor Deleted. See Packet(Packet&). */
     Packet() = delete;
 
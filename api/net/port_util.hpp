@@ -0,0 +1,97 @@
+// This file is a part of the IncludeOS unikernel - www.includeos.org
+//
+// Copyright 2015 Oslo and Akershus University College of Applied Sciences
+// and Alfred Bratterud
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef NET_PORT_UTIL_HPP
+#define NET_PORT_UTIL_HPP
+
+#include <array>
+#include <cstdint>
+#include <kernel/entropy.hpp>
+
+namespace net {
+
+  /**
+   *  A bitmap over all 65536 ports, for one transport protocol
+   *
+   *  Keeps track of bound ports, and hands out ephemeral ports.
+   *  The search for a free ephemeral port starts at a random offset
+   *  (RFC 6056, 3.3.1), and skips 32 taken ports at a time.
+   */
+  class Port_util {
+  public:
+    /** Ephemeral ports are handed out from this port and up */
+    static constexpr uint32_t ephemeral_min {1024};
+
+    Port_util() noexcept
+    { bits_.fill(0); }
+
+    bool is_bound(uint16_t port) const noexcept
+    { return bits_[port >> 5] & (1u << (port & 31)); }
+
+    void bind(uint16_t port) noexcept {
+      if (not is_bound(port)) bound_++;
+      bits_[port >> 5] |= 1u << (port & 31);
+    }
+
+    void unbind(uint16_t port) noexcept {
+      if (is_bound(port)) bound_--;
+      bits_[port >> 5] &= ~(1u << (port & 31));
+    }
+
+    /** Number of bound ports */
+    size_t bound() const noexcept
+    { return bound_; }
+
+    /**
+     *  Bind a free ephemeral port
+     *
+     *  @return The port, or 0 if they're all taken
+     */
+    uint16_t bind_ephemeral() noexcept {
+      constexpr uint32_t range = 65536 - ephemeral_min;
+      const uint32_t start = ephemeral_min + Entropy::random32() % range;
+
+      int port = first_free(start, 65536);
+      if (port < 0)
+        port = first_free(ephemeral_min, start);
+      if (port < 0)
+        return 0;
+
+      bind(port);
+      return port;
+    }
+
+  private:
+    std::array<uint32_t, 65536 / 32> bits_;
+    size_t bound_ {0};
+
+    /** First free port in [from, to), or -1 */
+    int first_free(uint32_t from, uint32_t to) const noexcept {
+      for (uint32_t p = from; p < to; p = (p & ~31u) + 32) {
+        const uint32_t free = ~bits_[p >> 5] & (~0u << (p & 31));
+        if (free) {
+          const uint32_t port = (p & ~31u) + __builtin_ctz(free);
+          return port < to ? port : -1;
+        }
+      }
+      return -1;
+    }
+  }; //< class Port_util
+
+} //< namespace net
+
+#endif //< NET_PORT_UTIL_HPP
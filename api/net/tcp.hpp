@@ -22,6 +22,12 @@
 #include "ip4/ip4.hpp" // IP4::Addr
 #include "ip4/packet_ip4.hpp" // PacketIP4
 #include "util.hpp" // net::Packet_ptr, htons / noths
+#include "port_util.hpp" // Port_util
+#include "connection_table.hpp" // Connection_table
+#include <utility/pool_allocator.hpp>
+#include <utility/lazy_deque.hpp>
+#include <utility/expected.hpp>
+#include <array>
 #include <queue> // buffer
 #include <map>
 #include <sstream> // ostringstream
@@ -45,6 +51,37 @@ namespace net {
     */
     using Seq = uint32_t;
 
+    /*
+      Sequence number comparison, modulo 2^32 [RFC 793 p. 24]
+    */
+    static inline bool seq_lt(Seq a, Seq b) { return (int32_t)(a - b) < 0; }
+
+    static inline bool seq_leq(Seq a, Seq b) { return (int32_t)(a - b) <= 0; }
+
+    /*
+      Millisecond clock for RTT measurement and timestamps.
+
+      Read from the TSC and scaled with a fixed-point multiplier, calibrated
+      against the PIT on first use, so it's cheap enough to read for every
+      segment. Wraps after ~49 days, which RFC 7323 is fine with.
+    */
+    class Clock {
+    public:
+      using tick_t = uint32_t;
+
+      static inline tick_t now() {
+        if(!mult_)
+          calibrate();
+        return ((OS::cycles_since_boot() >> 8) * mult_) >> 28;
+      }
+
+    private:
+      // 2^36 / cycles per ms
+      static uint64_t mult_;
+
+      static void calibrate();
+    };
+
     using buffer_t = std::shared_ptr<uint8_t>;
 
     class Packet;
@@ -57,6 +94,16 @@ namespace net {
     using Connection_ptr = std::shared_ptr<Connection>;
     using IPStack = Inet<LinkLayer,IP4>;
 
+    /*
+      Congestion control algorithms shipped with the stack.
+    */
+    enum Congestion {
+      NEWRENO,  // [RFC 5681] [RFC 6582]
+      CUBIC,    // [RFC 8312]
+      BBR,      // Cardwell et al., 2016
+      DCTCP     // [RFC 8257], needs ECN
+    };
+
   public:
     /*
       An IP address and a Port.
@@ -122,8 +169,29 @@ namespace net {
 
     static constexpr uint16_t default_window_size = 0xffff;
 
+    /*
+      Receive windows are auto-tuned up to this, when window scaling is on.
+    */
+    static constexpr uint32_t max_window_size = 4 * 1024 * 1024;
+
+    /*
+      Window scale offered in SYN (fits max_window_size in 16 bits) [RFC 7323]
+    */
+    static constexpr uint8_t default_window_shift = 7;
+
     static constexpr uint16_t default_mss = 536;
 
+    /*
+      Half-open connections a listener keeps state for, before SYN cookies take over.
+    */
+    static constexpr uint16_t default_syn_backlog = 128;
+
+    /*
+      Packets a connection may send per round, when connections wait for
+      the transmit queue (times the connection's weight).
+    */
+    static constexpr uint16_t default_tx_quantum = 8;
+
     /*
       Flags (Control bits) in the TCP Header.
     */
@@ -210,6 +278,14 @@ namespace net {
       TCP::Header tcp;
     }__attribute__((packed));
 
+    /*
+      A block of sequence space [left, right) (SACK) [RFC 2018]
+    */
+    struct Sack_block {
+      Seq left;
+      Seq right;
+    };
+
     /*
       TCP Header Option
     */
@@ -222,6 +298,11 @@ namespace net {
         END = 0x00, // End of option list
         NOP = 0x01, // No-Opeartion
         MSS = 0x02, // Maximum Segment Size [RFC 793] Rev: [879, 6691]
+        WS = 0x03, // Window Scale [RFC 7323]
+        SACK_PERM = 0x04, // SACK Permitted [RFC 2018]
+        SACK = 0x05, // Selective Acknowledgement [RFC 2018]
+        TS = 0x08, // Timestamps [RFC 7323]
+        TFO = 0x22, // TCP Fast Open Cookie [RFC 7413]
       };
 
       static std::string kind_string(Kind kind) {
@@ -229,6 +310,21 @@ namespace net {
         case MSS:
           return {"MSS"};
 
+        case WS:
+          return {"Window Scale"};
+
+        case SACK_PERM:
+          return {"SACK Permitted"};
+
+        case SACK:
+          return {"SACK"};
+
+        case TS:
+          return {"Timestamps"};
+
+        case TFO:
+          return {"Fast Open"};
+
         default:
           return {"Unknown Option"};
         }
@@ -243,11 +339,71 @@ namespace net {
           : kind(MSS), length(4), mss(htons(mss)) {}
       };
 
+      struct opt_ws {
+        uint8_t nop;
+        uint8_t kind;
+        uint8_t length;
+        uint8_t shift;
+
+        opt_ws(uint8_t shift)
+          : nop(NOP), kind(WS), length(3), shift(shift) {}
+      };
+
+      /*
+        Padded with NOPs to keep the header 32-bit aligned.
+      */
+      struct opt_sack_perm {
+        uint8_t nop[2];
+        uint8_t kind;
+        uint8_t length;
+
+        opt_sack_perm()
+          : nop{NOP, NOP}, kind(SACK_PERM), length(2) {}
+      };
+
+      struct opt_sack {
+        uint8_t nop[2];
+        uint8_t kind;
+        uint8_t length;
+        uint32_t edges[0]; // left and right edge of every block
+
+        // what fits in the 40 bytes of option space (without timestamps)
+        static constexpr size_t max_blocks = 4;
+
+        opt_sack(const Sack_block* blocks, size_t n)
+          : nop{NOP, NOP}, kind(SACK), length(2 + n*8)
+        {
+          for(size_t i = 0; i < n; i++) {
+            edges[i*2]   = htonl(blocks[i].left);
+            edges[i*2+1] = htonl(blocks[i].right);
+          }
+        }
+      }__attribute__((packed));
+
       struct opt_timestamp {
+        uint8_t nop[2];
         uint8_t kind;
         uint8_t length;
         uint32_t ts_val;
         uint32_t ts_ecr;
+
+        opt_timestamp(uint32_t val, uint32_t ecr)
+          : nop{NOP, NOP}, kind(TS), length(10), ts_val(htonl(val)), ts_ecr(htonl(ecr)) {}
+      }__attribute__((packed));
+
+      /*
+        An empty cookie asks for one. Only cookies of a multiple of
+        4 bytes are sent, so the NOPs keep it aligned.
+      */
+      struct opt_fastopen {
+        uint8_t nop[2];
+        uint8_t kind;
+        uint8_t length;
+        uint8_t cookie[0];
+
+        opt_fastopen(const uint8_t* data, uint8_t n)
+          : nop{NOP, NOP}, kind(TFO), length(2 + n)
+        { memcpy(cookie, data, n); }
       };
     };
 
@@ -430,7 +586,7 @@ namespace net {
       //! this will fill bytes from @buffer into this packets buffer,
       //! then return the number of bytes written. buffer is unmodified
       size_t fill(const char* buffer, size_t length) {
-        size_t rem = capacity() - all_headers_len();
+        size_t rem = capacity() - all_headers_len() - data_length();
         size_t total = (length < rem) ? length : rem;
         // copy from buffer to packet buffer
         memcpy(data() + data_length(), buffer, total);
@@ -477,6 +633,184 @@ namespace net {
       Option::Kind kind_;
     };
 
+    /*
+      Why a call on the control path (bind, open, send, receive, close)
+      didn't do anything.
+
+      Returned rather than thrown, as most of these are ordinary outcomes
+      a peer can provoke at will, like writing to a connection it just
+      closed, and unwinding costs far more than the call itself.
+    */
+    enum class Error : uint8_t {
+      NONE,
+      PORT_TAKEN,
+      NO_FREE_PORT,
+      EXISTS,
+      NO_REMOTE,
+      CLOSING,
+      NOT_OPEN,
+      LISTENING
+    };
+
+    static const char* error_string(Error err) {
+      switch(err) {
+      case Error::NONE:         return "No error.";
+      case Error::PORT_TAKEN:   return "Port is already taken.";
+      case Error::NO_FREE_PORT: return "All ports are taken.";
+      case Error::EXISTS:       return "Connection already exists.";
+      case Error::NO_REMOTE:    return "No remote host set.";
+      case Error::CLOSING:      return "Connection closing.";
+      case Error::NOT_OPEN:     return "Connection does not exist.";
+      case Error::LISTENING:    return "Cannot send on listening connection.";
+      default:                  return "Unknown error.";
+      }
+    }
+
+    /*
+      A result, or the Error telling why there is none.
+    */
+    template <typename T>
+    using Expected = ::Expected<T, Error>;
+
+    /*
+      A connection attempt that has only got as far as our SYN-ACK.
+
+      Kept small, so a SYN flood costs little; the Connection is only
+      created when the handshake completes [RFC 4987].
+    */
+    struct Half_open {
+      static constexpr uint8_t no_wscale = 0xff;
+
+      Seq irs = 0;
+      Seq iss = 0;
+      uint32_t ts_recent = 0;
+      Clock::tick_t sent = 0;     // last SYN-ACK
+      uint32_t wnd = 0;           // the peer's window
+      uint16_t mss = default_mss;
+      uint8_t wscale = no_wscale; // the peer's window scale, if any
+      uint8_t retries = 0;
+      bool sack = false;
+      bool ts = false;
+      bool ecn = false;
+      bool cookie = false;        // no state was kept, it's from a SYN cookie
+    };
+
+    /*
+      A TCP Fast Open cookie [RFC 7413]. Up to 12 bytes, what fits in
+      a SYN next to the other options.
+    */
+    struct Fastopen_cookie {
+      static constexpr uint8_t max_length = 12;
+
+      uint8_t data[max_length];
+      uint8_t length = 0;
+      bool present = false; // the option was there (empty is a request)
+
+      bool operator==(const Fastopen_cookie& other) const
+      { return length == other.length and !memcmp(data, other.data, length); }
+    };
+
+    /*
+      Congestion control for one connection.
+
+      The connection does loss detection and recovery (NewReno or SACK),
+      the algorithm decides what that does to cwnd and ssthresh.
+      Derive from this to plug in your own, see Connection::set_congestion_control.
+    */
+    class Congestion_control {
+    public:
+      virtual ~Congestion_control() = default;
+
+      virtual const char* name() const = 0;
+
+      /*
+        Set the initial window [RFC 5681 p. 5].
+      */
+      virtual void init(Connection&);
+
+      /*
+        New data was acknowledged, outside of loss recovery.
+      */
+      virtual void on_ack(Connection&, uint32_t bytes_acked) = 0;
+
+      /*
+        Loss detected from duplicate ACKs or SACK; recovery starts.
+        Set ssthresh and cwnd for the recovery.
+      */
+      virtual void on_loss(Connection&) = 0;
+
+      /*
+        Everything outstanding when recovery started is acknowledged.
+      */
+      virtual void on_recovery_done(Connection&);
+
+      /*
+        The retransmission timer expired. first is false for back-to-back timeouts.
+      */
+      virtual void on_rto(Connection&, bool first) = 0;
+
+      /*
+        A new round-trip time sample, in Clock ticks (ms).
+      */
+      virtual void on_rtt(Connection&, uint32_t)
+      {}
+
+      /*
+        The rate the algorithm wants to send at, in bytes per second. 0 if it doesn't care.
+      */
+      virtual uint32_t pacing_rate() const
+      { return 0; }
+
+      /*
+        With ECN, for every ACK of new data: ece if the network marked what
+        we sent [RFC 3168]. Returns true if cwnd went down, for the peer to
+        be told with CWR. The default halves it, once per window of data.
+      */
+      virtual bool on_ecn(Connection&, uint32_t bytes_acked, bool ece);
+
+      /*
+        Have the receiver echo exactly which segments were marked,
+        instead of ECE from the first CE until CWR.
+      */
+      virtual bool ecn_per_segment() const
+      { return false; }
+
+      /*
+        Create one of the algorithms shipped with the stack.
+      */
+      static std::unique_ptr<Congestion_control> create(Congestion);
+
+      /*
+        NewReno keeps nothing per connection: the one every connection
+        using it points to, instead of an allocation each.
+      */
+      static Congestion_control& newreno();
+
+    protected:
+      /* What the algorithms get to see of the connection */
+      static uint32_t cwnd(const Connection&);
+      static void set_cwnd(Connection&, uint32_t);
+      static uint32_t ssthresh(const Connection&);
+      static void set_ssthresh(Connection&, uint32_t);
+      static uint16_t smss(const Connection&);
+      static uint32_t flight_size(const Connection&);
+      static Seq snd_una(const Connection&);
+      static Seq snd_nxt(const Connection&);
+
+      /*
+        ssthresh = max(FlightSize / 2, 2*SMSS) [RFC 5681 p. 7]
+      */
+      static uint32_t half_flight(const Connection&);
+
+      /*
+        Whether cwnd went down for ECN in the window SND.UNA is still in,
+        and to note that it just did, up to SND.NXT. Kept by the
+        connection, so algorithms without state of their own can be shared.
+      */
+      static bool ecn_cut(const Connection&);
+      static void set_ecn_cut(Connection&);
+    };
+
     /*
       A connection between two Sockets (local and remote).
       Receives and handle TCP::Packet.
@@ -484,6 +818,7 @@ namespace net {
     */
     class Connection : public std::enable_shared_from_this<Connection> {
       friend class TCP;
+      friend class Congestion_control;
     public:
 
       /*
@@ -527,17 +862,100 @@ namespace net {
         }
 
         /*
-          Renews the ReadBuffer by assigning a new buffer_t, releasing ownership
+          Renews the ReadBuffer, releasing ownership of the buffer_t.
+          The new one is allocated when data arrives.
         */
         inline void renew() {
           remaining = capacity();
           offset = 0;
-          buffer = buffer_t(new uint8_t[remaining], std::default_delete<uint8_t[]>());
+          buffer.reset();
           push = false;
         }
+
+        /*
+          Allocate the buffer, unless there is one.
+        */
+        inline void allocate() {
+          if(!buffer)
+            buffer = buffer_t(new uint8_t[capacity()], std::default_delete<uint8_t[]>());
+        }
       }; // < Connection::ReadBuffer
 
 
+      /*
+        Received payload, pinned to the packet it arrived in.
+      */
+      struct Payload {
+        Packet_ptr packet;
+        const uint8_t* data;
+        size_t length;
+      };
+
+      /*
+        A chain of received payload, handed to the user without copying.
+        The bytes are taken from the receive window until the chain is released,
+        either by release() or when the chain is destroyed.
+        Move it out of the read callback to hold on to it.
+      */
+      class Payload_chain {
+      public:
+        Payload_chain() = default;
+
+        Payload_chain(Payload_chain&& other) noexcept
+          : views_(std::move(other.views_)), conn_(std::move(other.conn_)),
+            bytes_(other.bytes_), held_(other.held_)
+        { other.forget(); }
+
+        Payload_chain& operator=(Payload_chain&& other) noexcept {
+          if(this != &other) {
+            release();
+            views_ = std::move(other.views_);
+            conn_ = std::move(other.conn_);
+            bytes_ = other.bytes_;
+            held_ = other.held_;
+            other.forget();
+          }
+          return *this;
+        }
+
+        Payload_chain(const Payload_chain&) = delete;
+        Payload_chain& operator=(const Payload_chain&) = delete;
+
+        ~Payload_chain()
+        { release(); }
+
+        inline auto begin() const { return views_.begin(); }
+
+        inline auto end() const { return views_.end(); }
+
+        inline size_t size() const { return views_.size(); }
+
+        inline bool empty() const { return views_.empty(); }
+
+        /* Total payload bytes in the chain */
+        inline size_t bytes() const { return bytes_; }
+
+        /*
+          Drop the packets and give the bytes back to the receive window.
+        */
+        void release();
+
+      private:
+        friend class Connection;
+        std::vector<Payload> views_;
+        std::weak_ptr<Connection> conn_;
+        size_t bytes_ = 0;
+        uint32_t held_ = 0;
+
+        inline void forget() {
+          views_.clear();
+          conn_.reset();
+          bytes_ = 0;
+          held_ = 0;
+        }
+      }; // < Connection::Payload_chain
+
+
       /*
         Wrapper around a buffer that contains data to be written.
       */
@@ -582,14 +1000,18 @@ namespace net {
       */
       using ReadCallback = delegate<void(buffer_t, size_t)>;
 
+      /*
+        Callback when received payload is pushed, or the requested amount is reached
+        - Supplied on asynchronous read_payload
+      */
+      using PayloadCallback = delegate<void(Payload_chain&)>;
+
       struct ReadRequest {
         ReadBuffer buffer;
         ReadCallback callback;
 
         ReadRequest(ReadBuffer buf, ReadCallback cb) : buffer(buf), callback(cb) {}
-        ReadRequest(size_t n = 0) :
-          buffer(buffer_t(new uint8_t[n], std::default_delete<uint8_t[]>()), n),
-          callback([](auto, auto){}) {}
+        ReadRequest(size_t n = 0) : buffer(buffer_t(), n), callback() {}
       };
 
       /*
@@ -608,12 +1030,15 @@ namespace net {
       */
       struct WriteQueue {
 
-        std::deque<WriteRequest> q;
+        Lazy_deque<WriteRequest> q;
 
         /* Current element (index + 1) */
         uint32_t current;
 
-        WriteQueue() : q(), current(0) {}
+        /* Bytes not yet sent, over all requests */
+        size_t unsent;
+
+        WriteQueue() : q(), current(0), unsent(0) {}
 
         /*
           Acknowledge n bytes from the write queue.
@@ -659,24 +1084,59 @@ namespace net {
         const WriteBuffer& una()
         { return q.front().first; }
 
+        /*
+          The sent data @off bytes past the oldest unacknowledged byte,
+          and (in @len) how much of it is contiguous.
+        */
+        const uint8_t* at(uint32_t off, size_t& len) const {
+          for(auto& req : q) {
+            auto& buf = req.first;
+            auto unacked = buf.offset - buf.acknowledged;
+            if(off < unacked) {
+              len = unacked - off;
+              return buf.begin() + buf.acknowledged + off;
+            }
+            off -= unacked;
+          }
+          len = 0;
+          return nullptr;
+        }
+
+        /*
+          Copy up to n unsent bytes into packet, across as many requests as
+          needed, without advancing. Returns the bytes copied.
+        */
+        size_t peek(TCP::Packet& packet, size_t n) const {
+          size_t total = 0;
+          for(auto i = current-1; i < q.size() and total < n; i++) {
+            auto& buf = q[i].first;
+            total += packet.fill((char*)buf.pos(), std::min(buf.remaining, n - total));
+          }
+          return total;
+        }
+
         /*
           Advances the queue forward.
           If current buffer finishes; exec user callback and step to next.
         */
         void advance(size_t bytes) {
-
-          auto& buf = q[current-1].first;
-          buf.advance(bytes);
-
-          debug2("<Connection::WriteQueue> Advance: bytes=%u off=%u rem=%u ack=%u\n",
-            bytes, buf.offset, buf.remaining, buf.acknowledged);
-
-          if(!buf.remaining) {
-            debug("<Connection::WriteQueue> Advance: Done (%u)\n",
-              buf.offset);
-            // make sure to advance current before callback is made,
-            // but after index (current) is received.
-            q[current++-1].second(buf.offset);
+          while(bytes) {
+            auto& buf = q[current-1].first;
+            auto n = std::min(bytes, buf.remaining);
+            buf.advance(n);
+            unsent -= n;
+            bytes -= n;
+
+            debug2("<Connection::WriteQueue> Advance: bytes=%u off=%u rem=%u ack=%u\n",
+              n, buf.offset, buf.remaining, buf.acknowledged);
+
+            if(!buf.remaining) {
+              debug("<Connection::WriteQueue> Advance: Done (%u)\n",
+                buf.offset);
+              // make sure to advance current before callback is made,
+              // but after index (current) is received.
+              q[current++-1].second(buf.offset);
+            }
           }
         }
 
@@ -686,6 +1146,7 @@ namespace net {
         */
         void push_back(const WriteRequest& wr) {
           q.push_back(wr);
+          unsent += wr.first.remaining;
           debug("<Connection::WriteQueue> Inserted WR: off=%u rem=%u ack=%u\n",
             wr.first.offset, wr.first.remaining, wr.first.acknowledged);
           if(current == q.size()-1)
@@ -704,10 +1165,203 @@ namespace net {
               req.second(req.first.offset);
             q.pop_front();
           }
+          unsent = 0;
         }
       }; // < TCP::Connection::WriteQueue
 
 
+      /*
+        Out-of-order segments waiting for the gap in front of them to be filled.
+
+        Holds on to the packets themselves (no copying), each trimmed to the
+        part of the sequence space no other segment covers, so the queue is
+        always sorted and free of overlaps. Adjacent segments form the
+        contiguous ranges reported back to the sender.
+      */
+      struct ReassemblyQueue {
+
+        struct Segment {
+          TCP::Packet_ptr packet;
+          Seq begin;
+          Seq end;
+
+          inline uint32_t length() const
+          { return end - begin; }
+
+          inline const uint8_t* data() const
+          { return (uint8_t*)packet->data() + (begin - packet->seq()); }
+        };
+
+        /* Packets are borrowed from the NIC buffer pool; don't hog it */
+        static constexpr size_t max_segments = 64;
+
+        Lazy_deque<Segment> q;
+
+        /* Start of the latest segment queued */
+        Seq latest;
+
+        ReassemblyQueue() : q(), latest(0) {}
+
+        bool empty() const
+        { return q.empty(); }
+
+        size_t size() const
+        { return q.size(); }
+
+        const Segment& front() const
+        { return q.front(); }
+
+        void pop_front()
+        { q.pop_front(); }
+
+        /* Bytes held, counted when asked: it's only for debugging */
+        uint32_t bytes() const {
+          uint32_t n = 0;
+          for(auto& seg : q)
+            n += seg.length();
+          return n;
+        }
+
+        /*
+          Insert [begin, end) from packet, keeping only the bytes not already held.
+          Returns false if nothing new was queued.
+        */
+        bool insert(TCP::Packet_ptr packet, Seq begin, Seq end) {
+          auto it = q.begin();
+          // skip segments entirely in front
+          while(it != q.end() and seq_leq(it->end, begin))
+            ++it;
+          // the start is already held
+          if(it != q.end() and seq_leq(it->begin, begin)) {
+            begin = it->end;
+            ++it;
+          }
+          // remove segments the new one covers
+          while(it != q.end() and seq_leq(it->end, end))
+            it = q.erase(it);
+          // the end is already held
+          if(it != q.end() and seq_lt(it->begin, end))
+            end = it->begin;
+
+          if(!seq_lt(begin, end) or q.size() >= max_segments)
+            return false;
+
+          q.insert(it, {packet, begin, end});
+          latest = begin;
+          return true;
+        }
+
+        /*
+          The contiguous ranges held, at most n. The range holding the
+          latest segment goes first [RFC 2018 p. 5], the rest in order.
+        */
+        size_t sack_blocks(Sack_block* out, size_t n) const {
+          if(q.empty() or !n)
+            return 0;
+          size_t count = 1;
+          bool found = false;
+          Sack_block range = {q.front().begin, q.front().end};
+          for(size_t i = 1; i <= q.size(); i++) {
+            // extend the current range, or close it
+            if(i < q.size() and q[i].begin == range.right) {
+              range.right = q[i].end;
+              continue;
+            }
+            if(!found and seq_leq(range.left, latest) and seq_lt(latest, range.right)) {
+              out[0] = range;
+              found = true;
+            }
+            else if(count < n) {
+              out[count++] = range;
+            }
+            if(i < q.size())
+              range = {q[i].begin, q[i].end};
+          }
+          // the latest segment has been delivered since
+          if(!found) {
+            for(size_t i = 1; i < count; i++)
+              out[i-1] = out[i];
+            count--;
+          }
+          return count;
+        }
+
+        void clear()
+        { q.clear(); }
+      }; // < TCP::Connection::ReassemblyQueue
+
+
+      /*
+        Sender side record of what the receiver has SACKed above SND.UNA.
+        Blocks are kept sorted and merged.
+      */
+      struct Scoreboard {
+
+        // [RFC 6675]
+        static constexpr uint32_t dup_thresh = 3;
+
+        // only there while something is SACKed
+        Lazy_deque<Sack_block> blocks;
+
+        bool empty() const
+        { return blocks.empty(); }
+
+        void insert(Seq left, Seq right) {
+          auto it = blocks.begin();
+          while(it != blocks.end() and seq_lt(it->right, left))
+            ++it;
+          // merge every block overlapping or touching the new one
+          while(it != blocks.end() and seq_leq(it->left, right)) {
+            if(seq_lt(it->left, left))
+              left = it->left;
+            if(seq_lt(right, it->right))
+              right = it->right;
+            it = blocks.erase(it);
+          }
+          blocks.insert(it, {left, right});
+        }
+
+        /*
+          Forget everything below the new SND.UNA.
+        */
+        void acknowledge(Seq una) {
+          auto it = blocks.begin();
+          while(it != blocks.end() and seq_leq(it->right, una))
+            ++it;
+          blocks.erase(blocks.begin(), it);
+          if(blocks.empty())
+            blocks.clear();
+          else if(seq_lt(blocks.front().left, una))
+            blocks.front().left = una;
+        }
+
+        bool is_sacked(Seq seq) const {
+          for(auto& b : blocks)
+            if(seq_leq(b.left, seq) and seq_lt(seq, b.right))
+              return true;
+          return false;
+        }
+
+        /*
+          IsLost() [RFC 6675 p. 6]
+        */
+        bool is_lost(Seq seq, uint32_t smss) const {
+          uint32_t sacked = 0;
+          size_t n = 0;
+          for(auto& b : blocks) {
+            if(seq_lt(seq, b.left)) {
+              sacked += b.right - b.left;
+              n++;
+            }
+          }
+          return n >= dup_thresh or sacked > (dup_thresh - 1) * smss;
+        }
+
+        void clear()
+        { blocks.clear(); }
+      }; // < TCP::Connection::Scoreboard
+
+
       /*
         Connection identifier
       */
@@ -726,6 +1380,11 @@ namespace net {
       */
       using ConnectCallback                     = delegate<void(std::shared_ptr<Connection>)>;
 
+      /*
+        On acceptable - When a listener with a backlog has a connection waiting for accept().
+      */
+      using AcceptableCallback                  = delegate<void(Connection& listener)>;
+
       /*
         On disconnect - When a remote told it wanna close the connection.
         Connection has received a FIN, currently last thing that will happen before a connection is remoed.
@@ -762,7 +1421,8 @@ namespace net {
         enum Reason {
           CLOSING,
           REFUSED,
-          RESET
+          RESET,
+          TIMEOUT
         };
 
         Reason reason;
@@ -783,6 +1443,8 @@ namespace net {
             return "Connection refused";
           case RESET:
             return "Connection reset";
+          case TIMEOUT:
+            return "Connection timed out";
           default:
             return "Unknown reason";
           }
@@ -803,25 +1465,27 @@ namespace net {
           Open a Connection.
           OPEN
         */
-        virtual void open(Connection&, bool active = false);
+        virtual Error open(Connection&, bool active = false);
 
         /*
           Write to a Connection.
           SEND
+
+          Returns the bytes taken from the buffer.
         */
-        virtual size_t send(Connection&, WriteBuffer&);
+        virtual Expected<size_t> send(Connection&, WriteBuffer&);
 
         /*
           Read from a Connection.
           RECEIVE
         */
-        virtual void receive(Connection&, ReadBuffer&);
+        virtual Error receive(Connection&, ReadBuffer&);
 
         /*
           Close a Connection.
           CLOSE
         */
-        virtual void close(Connection&);
+        virtual Error close(Connection&);
 
         /*
           Terminate a Connection.
@@ -904,22 +1568,24 @@ namespace net {
         struct {
           TCP::Seq UNA; // send unacknowledged
           TCP::Seq NXT; // send next
-          uint16_t WND; // send window
+          uint32_t WND; // send window
           uint16_t UP;  // send urgent pointer
           TCP::Seq WL1; // segment sequence number used for last window update
           TCP::Seq WL2; // segment acknowledgment number used for last window update
 
           uint16_t MSS; // Maximum segment size for outgoing segments.
+          uint8_t wind_shift; // Snd.Wind.Shift [RFC 7323]
         } SND; // <<
         TCP::Seq ISS;           // initial send sequence number
 
         /* Receive Sequence Variables */
         struct {
           TCP::Seq NXT; // receive next
-          uint16_t WND; // receive window
-          uint16_t UP;  // receive urgent pointer
+          uint32_t WND; // receive window
+          uint32_t rwnd; // receivers advertised window [RFC 5681]
 
-          uint16_t rwnd; // receivers advertised window [RFC 5681]
+          uint16_t UP;  // receive urgent pointer
+          uint8_t wind_shift; // Rcv.Wind.Shift [RFC 7323]
         } RCV; // <<
         TCP::Seq IRS;           // initial receive sequence number
 
@@ -928,17 +1594,17 @@ namespace net {
         Seq recover; // New Reno [RFC 6582]
 
         TCB() {
-          SND = { 0, 0, TCP::default_window_size, 0, 0, 0, TCP::default_mss };
-          ISS = (Seq)4815162342;
-          RCV = { 0, TCP::default_window_size, 0, 0 };
+          SND = { 0, 0, TCP::default_window_size, 0, 0, 0, TCP::default_mss, 0 };
+          ISS = 0; // set on open
+          RCV = { 0, TCP::default_window_size, 0, 0, 0 };
           IRS = 0;
           ssthresh = TCP::default_window_size;
           cwnd = 0;
           recover = 0;
         };
 
-        void init() {
-          ISS = TCP::generate_iss();
+        void init(Seq iss) {
+          ISS = iss;
           recover = ISS; // [RFC 6582]
         }
 
@@ -993,10 +1659,10 @@ namespace net {
         Create n sized internal read buffer and callback for when data is received.
         Callback will be called until overwritten with a new read() or connection closes.
         Buffer is cleared for data after every reset.
+        The buffer is allocated when data arrives.
       */
       inline void read(size_t n, ReadCallback callback) {
-        ReadBuffer buffer = {buffer_t(new uint8_t[n], std::default_delete<uint8_t[]>()), n};
-        read(buffer, callback);
+        read(ReadBuffer{buffer_t(), n}, callback);
       }
 
       /*
@@ -1009,6 +1675,17 @@ namespace net {
 
       void read(ReadBuffer buffer, ReadCallback callback);
 
+      /*
+        Read asynchronous from a remote, without copying.
+
+        Received payload is handed over as views into the packets it arrived in,
+        when pushed or when n bytes are pending. Replaces any read() buffer.
+        What the user holds on to is taken from the receive window (RCV.WND)
+        until released, so a slow reader closes the window instead of
+        running the stack out of packets.
+      */
+      void read_payload(size_t n, PayloadCallback callback);
+
 
       /*
         Write asynchronous to a remote.
@@ -1076,18 +1753,113 @@ namespace net {
       }
 
       /*
-        Set callback for ACCEPT event.
+        Half-open connections to keep state for while listening.
+        When they're all taken, SYN cookies are used instead.
       */
-      inline Connection& onAccept(AcceptCallback callback) {
-        on_accept_ = callback;
+      inline Connection& set_syn_backlog(uint16_t backlog) {
+        cold().syn_backlog = backlog;
         return *this;
       }
 
+      inline uint16_t syn_backlog() const
+      { return cold_ ? cold_->syn_backlog : TCP::default_syn_backlog; }
+
+      inline uint16_t syn_queued() const
+      { return cold_ ? cold_->syn_queued : 0; }
+
       /*
-        Set callback for CONNECT event.
+        Accept queue (listen backlog). With a backlog, established
+        connections aren't handed to onConnect right away, but wait on
+        the listener until the application takes them with accept().
+        While backlog of them are waiting, new SYNs are dropped.
+        0 (default) for no queue.
+      */
+      inline Connection& set_backlog(uint16_t backlog) {
+        cold().backlog = backlog;
+        return *this;
+      }
+
+      inline uint16_t backlog() const
+      { return cold_ ? cold_->backlog : 0; }
+
+      inline size_t accept_queued() const
+      { return cold_ ? cold_->accept_queue.size() : 0; }
+
+      /*
+        Take the next connection waiting on the listener, and signal
+        its onConnect. nullptr if there's none.
+      */
+      Connection_ptr accept();
+
+      /*
+        Set callback for when a connection is waiting to be accepted.
+      */
+      inline Connection& onAcceptable(AcceptableCallback callback) {
+        cold().on_acceptable = callback;
+        return *this;
+      }
+
+      /*
+        Hold back connections until they've sent something (TCP_DEFER_ACCEPT),
+        so the application isn't bothered with those that never do. They're
+        reset if nothing arrives within timeout. 0 (default) to turn off.
+      */
+      inline Connection& set_defer_accept(std::chrono::seconds timeout) {
+        Expects(timeout.count() >= 0 and timeout.count() <= UINT16_MAX);
+        cold().defer_accept = timeout.count();
+        return *this;
+      }
+
+      inline std::chrono::seconds defer_accept() const
+      { return std::chrono::seconds(cold_ ? cold_->defer_accept : 0); }
+
+      /*
+        TCP Fast Open [RFC 7413]: hand out cookies, and take the data in
+        a SYN with a valid one, so the connection is handed over (and may
+        answer) before the handshake completes. Off by default.
+      */
+      inline Connection& set_fastopen(bool on) {
+        cold().fastopen = on;
+        return *this;
+      }
+
+      inline bool fastopen() const
+      { return cold_ and cold_->fastopen; }
+
+      /*
+        Pace what's sent instead of putting a window's worth on the wire at
+        once: at rate bytes per second, or (0) at the rate the congestion
+        control asks for, or one from cwnd and SRTT. Off by default.
+      */
+      inline Connection& set_pacing(bool on, uint32_t rate = 0) {
+        auto& pacing = cold().pacing;
+        pacing.on = on;
+        pacing.rate = rate;
+        return *this;
+      }
+
+      inline bool paced() const
+      { return cold_ and cold_->pacing.on; }
+
+      /*
+        The rate sent at, in bytes per second. 0 when not paced,
+        or when there's nothing to go by yet.
+      */
+      uint32_t pacing_rate() const;
+
+      /*
+        Set callback for ACCEPT event.
+      */
+      inline Connection& onAccept(AcceptCallback callback) {
+        callbacks().on_accept = callback;
+        return *this;
+      }
+
+      /*
+        Set callback for CONNECT event.
       */
       inline Connection& onConnect(ConnectCallback callback) {
-        on_connect_ = callback;
+        callbacks().on_connect = callback;
         return *this;
       }
 
@@ -1095,7 +1867,7 @@ namespace net {
         Set callback for DISCONNECT event.
       */
       inline Connection& onDisconnect(DisconnectCallback callback) {
-        on_disconnect_ = callback;
+        callbacks().on_disconnect = callback;
         return *this;
       }
 
@@ -1103,7 +1875,7 @@ namespace net {
         Set callback for ERROR event.
       */
       inline Connection& onError(ErrorCallback callback) {
-        on_error_ = callback;
+        callbacks().on_error = callback;
         return *this;
       }
 
@@ -1111,7 +1883,7 @@ namespace net {
         Set callback for every packet received.
       */
       inline Connection& onPacketReceived(PacketReceivedCallback callback) {
-        on_packet_received_ = callback;
+        callbacks().on_packet_received = callback;
         return *this;
       }
 
@@ -1119,7 +1891,7 @@ namespace net {
         Set callback for when a packet is dropped.
       */
       inline Connection& onPacketDropped(PacketDroppedCallback callback) {
-        on_packet_dropped_ = callback;
+        callbacks().on_packet_dropped = callback;
         return *this;
       }
 
@@ -1164,7 +1936,7 @@ namespace net {
         Bytes currently in receive buffer.
       */
       inline size_t read_queue_bytes() const {
-        return read_request.buffer.size();
+        return cold_ ? cold_->read_request.buffer.size() + cold_->rcv_payload.chain.bytes() : 0;
       }
 
       /*
@@ -1201,6 +1973,107 @@ namespace net {
         return state_->to_string() == state_str;
       }
 
+      /*
+        Use another congestion control algorithm for this connection.
+      */
+      void set_congestion_control(Congestion);
+
+      void set_congestion_control(std::unique_ptr<Congestion_control>);
+
+      inline const char* congestion_control() const
+      { return cc_->name(); }
+
+      /*
+        Turn off Nagle's algorithm (TCP_NODELAY): small segments are sent
+        right away, even with data in flight.
+      */
+      inline void set_nodelay(bool nodelay) {
+        nodelay_ = nodelay;
+        if(nodelay and is_writable())
+          writeq_push();
+      }
+
+      inline bool nodelay() const
+      { return nodelay_; }
+
+      /*
+        Cork (TCP_CORK): hold back everything but full-sized segments
+        until uncorked, so many small writes go out as few segments.
+      */
+      inline void cork()
+      { corked_ = true; }
+
+      inline void uncork() {
+        corked_ = false;
+        if(is_writable())
+          writeq_push();
+      }
+
+      inline bool is_corked() const
+      { return corked_; }
+
+      /*
+        Share of the transmit queue when connections wait for it:
+        a connection with weight 2 gets twice the packets per round.
+      */
+      inline void set_tx_weight(uint8_t weight) {
+        Expects(weight > 0);
+        tx_weight_ = weight;
+      }
+
+      inline uint8_t tx_weight() const
+      { return tx_weight_; }
+
+      /*
+        Data packets sent, since TCP::reset_tx_stats().
+      */
+      inline uint32_t tx_packets() const
+      { return tx_packets_; }
+
+      /*
+        Acknowledge every data segment right away (true),
+        or delay ACKs as RFC 1122 allows (false, default).
+      */
+      inline void set_quickack(bool quick)
+      { delack.quick = quick; }
+
+      inline bool is_quickack() const
+      { return delack.quick; }
+
+      /*
+        Acknowledge the next n data segments right away, then go back to delaying.
+      */
+      inline void quickack_next(uint16_t n)
+      { delack.quickacks = n; }
+
+      /*
+        Probe the peer when it's been quiet for a while (SO_KEEPALIVE),
+        and reset the connection if it doesn't answer. Off by default,
+        see TCP::set_keepalive for the timing [RFC 1122 4.2.3.6].
+      */
+      inline void set_keepalive(bool keepalive) {
+        idle_.keepalive = keepalive;
+        idle_arm();
+      }
+
+      inline bool keepalive() const
+      { return idle_.keepalive; }
+
+      /*
+        Reset the connection when nothing has been received for this long,
+        0 for never (default). Set on a listener, it goes for every
+        connection it accepts. Shortening it on a connection already
+        being timed takes effect from its next check.
+      */
+      inline void set_idle_timeout(std::chrono::seconds timeout) {
+        Expects(timeout.count() >= 0 and timeout.count() <= UINT16_MAX);
+        idle_.timeout = timeout.count();
+        idle_arm();
+      }
+
+      inline std::chrono::seconds idle_timeout() const
+      { return std::chrono::seconds(idle_.timeout); }
+
       /*
         Destroy the Connection.
 
@@ -1234,75 +2107,230 @@ namespace net {
       TCB cb;                // 36 B
 
       /*
-        The given read request
+        Queue for write requests to process
       */
-      ReadRequest read_request;
+      WriteQueue writeq;
 
       /*
-        Queue for write requests to process
+        Segments received ahead of RCV.NXT
       */
-      WriteQueue writeq;
+      ReassemblyQueue reassq;
+
+      /*
+        The cold part: what only a connection being read from, a paced
+        one, one the network marked, or a listener, needs. Allocated on
+        first use, so idle connections stay small.
+      */
+      struct Cold {
+        /*
+          Listening: half-open connections allowed, and in use.
+        */
+        uint16_t syn_backlog = TCP::default_syn_backlog;
+        uint16_t syn_queued = 0;
+
+        /*
+          Listening: established connections waiting for accept(),
+          and seconds to wait for data before queueing them.
+        */
+        uint16_t backlog = 0;
+        uint16_t defer_accept = 0;
+        Lazy_deque<Connection_ptr> accept_queue;
+        AcceptableCallback on_acceptable;
+
+        /*
+          Listening: TCP Fast Open
+        */
+        bool fastopen = false;
+
+        /*
+          Pacing: a byte budget, refilled at the pacing rate as the
+          milliseconds go by, and spent by what's transmitted.
+        */
+        struct {
+          uint32_t rate = 0;      // set, or 0 for what pacing_rate() finds
+          int32_t credit = 0;
+          Clock::tick_t last = 0; // last refill
+          bool on = false;
+          bool waiting = false;   // on the TCP's pacing list
+        } pacing;
+
+        /*
+          The given read request
+        */
+        ReadRequest read_request;
+
+        /*
+          The given zero-copy read request, and the payload not yet delivered
+        */
+        struct {
+          PayloadCallback callback;
+          size_t max = 0;
+          Payload_chain chain;
+          uint32_t held = 0;  // taken from RCV.WND, in chains not yet released
+        } rcv_payload;
+
+        /*
+          Receive window auto-tuning.
+
+          Once per RTT, the window is set to twice what the application
+          consumed the last RTT (if that's more than before), so the window
+          keeps ahead of the sender for as long as the application keeps up.
+          RCV.WND is the target less what zero-copy reads still hold.
+        */
+        struct {
+          uint32_t bytes = 0; // consumed since time
+          uint32_t space = 0; // most consumed in one RTT
+          uint32_t target = 0; // the window with nothing held, 0 until known
+          Clock::tick_t time = 0;
+        } rcv_tune;
+
+        /*
+          ECN: the end of the window the last cut covers, see ecn_cut.
+        */
+        Seq ecn_end = 0;
+      };
+      std::unique_ptr<Cold> cold_;
+
+      inline Cold& cold() {
+        if(!cold_)
+          cold_.reset(new Cold);
+        return *cold_;
+      }
+
+      /*
+        Keepalive and idle timeout, in ticks of the TCP's idle wheel
+        (seconds), which the connection sits on while armed.
+      */
+      struct {
+        uint16_t timeout;     // 0 for never
+        uint16_t last;        // when the last segment arrived
+        uint8_t probes : 6;   // keepalives unanswered
+        bool keepalive : 1;
+        bool armed : 1;
+      } idle_;
 
       /*
         State if connection is in TCP write queue or not.
       */
       bool queued_;
 
+      /*
+        Transmit scheduling: weight, and packets left of this round.
+      */
+      uint8_t tx_weight_ = 1;
+      uint32_t tx_deficit_ = 0;
+      uint32_t tx_packets_ = 0;
+
+      /*
+        Take the callbacks and options of a listener, for a connection it accepted.
+      */
+      void inherit(const Connection& listener);
+
+      /*
+        Pick up a completed handshake, in SYN-RECEIVED.
+      */
+      void accept_handshake(const Half_open&);
+
+      /*
+        TCP Fast Open: take the data in the SYN, answer it,
+        and hand the connection over.
+      */
+      void fastopen_accepted(TCP::Packet_ptr syn);
+
+      /*
+        TCP Fast Open: the handshake's ACK covers data too, SND.UNA
+        has moved past what was sent before it completed.
+      */
+      void fastopen_acked();
+
+      /*
+        In SYN-RECEIVED: the peer's SYN carried data that was taken.
+      */
+      inline bool syn_data_accepted() const
+      { return cb.RCV.NXT != cb.IRS + 1; }
+
+      /*
+        Sequence number of the first byte in the write queue. Past our
+        SYN while that's unacknowledged, as with Fast Open.
+      */
+      inline Seq writeq_start() const
+      { return cb.SND.UNA == cb.ISS ? cb.ISS + 1 : cb.SND.UNA; }
+
+      /*
+        Our SYN. The first one carries what's in the write queue when
+        there's a Fast Open cookie for the remote, or asks for one.
+      */
+      void send_syn(bool first);
+
+      /*
+        Our SYN-ACK, for a connection created in SYN-RECEIVED.
+      */
+      void send_synack();
+
       struct {
         hw::PIT::Timer_iterator iter;
         bool active = false;
-        size_t i = 0;
       } rtx_timer;
 
-      /*
-        When time-wait timer was started.
-      */
-      uint64_t time_wait_started;
-
 
 
       // [RFC 6298]
       // Round Trip Time Measurer
+      //
+      // Everything is in (integer) Clock ticks. SRTT and RTTVAR are kept
+      // scaled by 1/alpha and 1/beta, so the updates are shifts and adds.
       struct RTTM {
-        using timestamp_t = double;
-        using duration_t = double;
+        using timestamp_t = Clock::tick_t;
+        using duration_t = uint32_t;
 
         // clock granularity
-        //static constexpr duration_t CLOCK_G = hw::PIT::frequency().count() / 1000;
-        static constexpr duration_t CLOCK_G = 0.0011;
+        static constexpr duration_t CLOCK_G = 1;
 
-        static constexpr double K = 4.0;
+        // [RFC 6298] (2.4) and (2.5)
+        static constexpr duration_t RTO_MIN = 1000;
+        static constexpr duration_t RTO_MAX = 60000;
 
-        static constexpr double alpha = 1.0/8;
-        static constexpr double beta = 1.0/4;
+        // alpha = 1/8, beta = 1/4, K = 4
+        static constexpr int alpha_shift = 3;
+        static constexpr int beta_shift = 2;
 
         timestamp_t t; // tick when measure is started
 
-        duration_t SRTT; // smoothed round-trip time
-        duration_t RTTVAR; // round-trip time variation
-        duration_t RTO; // retransmission timeout
+        duration_t SRTT8;   // smoothed round-trip time, << 3
+        duration_t RTTVAR4; // round-trip time variation, << 2
+        duration_t RTO;     // retransmission timeout
 
         bool active = false;
+        bool measured = false;
 
-        RTTM() : t(OS::uptime()), SRTT(1.0), RTTVAR(1.0), RTO(1.0), active(false) {}
+        RTTM() : t(0), SRTT8(1000 << alpha_shift), RTTVAR4(1000 << beta_shift), RTO(RTO_MIN),
+                 active(false), measured(false) {}
+
+        inline duration_t SRTT() const
+        { return SRTT8 >> alpha_shift; }
 
         void start() {
-          t = OS::uptime();
+          t = Clock::now();
           active = true;
         }
 
-        void stop(bool first = false) {
+        duration_t stop() {
           assert(active);
           active = false;
-          // round trip time (RTT)
-          auto rtt = OS::uptime() - t;
-          debug2("<TCP::Connection::RTT> RTT: %ums\n",
-            (uint32_t)(rtt * 1000));
-          if(!first)
-            sub_rtt_measurement(rtt);
-          else {
-            first_rtt_measurement(rtt);
-          }
+          const duration_t R = Clock::now() - t;
+          sample(R);
+          return R;
+        }
+
+        /*
+          Feed a round-trip time measurement R.
+        */
+        void sample(duration_t R) {
+          debug2("<TCP::Connection::RTT> RTT: %ums\n", R);
+          if(!measured)
+            first_rtt_measurement(R);
+          else
+            sub_rtt_measurement(R);
         }
 
         /*
@@ -1315,8 +2343,9 @@ namespace net {
           where K = 4.
         */
         inline void first_rtt_measurement(duration_t R) {
-          SRTT = R;
-          RTTVAR = R/2;
+          SRTT8 = R << alpha_shift;
+          RTTVAR4 = (R << beta_shift) / 2;
+          measured = true;
           update_rto();
         }
 
@@ -1338,55 +2367,120 @@ namespace net {
           RTO <- SRTT + max (G, K*RTTVAR)
         */
         inline void sub_rtt_measurement(duration_t R) {
-          RTTVAR = (1 - beta) * RTTVAR + beta * std::abs(SRTT-R);
-          SRTT = (1 - alpha) * SRTT + alpha * R;
+          int32_t err = (int32_t)R - (int32_t)SRTT();
+          RTTVAR4 += std::abs(err) - (int32_t)(RTTVAR4 >> beta_shift);
+          SRTT8 += err;
           update_rto();
         }
 
         inline void update_rto() {
-          RTO = std::max(SRTT + std::max(CLOCK_G, K * RTTVAR), 1.0);
-          debug2("<TCP::Connection::RTO> RTO updated: %ums\n",
-            (uint32_t)(RTO * 1000));
+          // K*RTTVAR is RTTVAR4 itself
+          auto rto = SRTT() + std::max(CLOCK_G, RTTVAR4);
+          RTO = std::min(std::max(rto, RTO_MIN), RTO_MAX);
+          debug2("<TCP::Connection::RTO> RTO updated: %ums\n", RTO);
         }
 
+        /*
+          (5.5) back off the timer
+        */
+        inline void backoff()
+        { RTO = std::min(RTO * 2, RTO_MAX); }
+
       } rttm;
 
+      /// Timestamps [RFC 7323] ///
+      struct {
+        bool ok = false;        // both ends send timestamps
+        bool seen = false;      // the current segment has a timestamp
+        uint32_t val = 0;       // TSval of the current segment
+        uint32_t ecr = 0;       // TSecr of the current segment
+        uint32_t recent = 0;    // TS.Recent
+        Seq last_ack_sent = 0;  // Last.ACK.sent
+      } ts;
 
-      /// CALLBACK HANDLING ///
+      /*
+        PAWS: Is the segment older than what we've already seen [RFC 7323 p. 19]
+      */
+      inline bool paws_reject(TCP::Packet_ptr in) {
+        return ts.ok and ts.seen and !in->isset(RST) and seq_lt(ts.val, ts.recent);
+      }
 
-      /* When a Connection is initiated. */
-      AcceptCallback on_accept_ = AcceptCallback::from<Connection,&Connection::default_on_accept>(this);
-      inline bool default_on_accept(std::shared_ptr<Connection>) {
-        //debug2("<TCP::Connection::@Accept> Connection attempt from: %s \n", conn->remote().to_string().c_str());
-        return true; // Always accept
+      /*
+        Take an RTT sample, from the echoed timestamp or the running measurement.
+      */
+      inline void rtt_sample() {
+        if(ts.ok and ts.seen and ts.ecr) {
+          const uint32_t R = Clock::now() - ts.ecr;
+          rttm.sample(R);
+          cc_->on_rtt(*this, R);
+        }
+        else if(rttm.active)
+          cc_->on_rtt(*this, rttm.stop());
       }
 
-      /* When Connection is ESTABLISHED. */
-      ConnectCallback on_connect_ = [](std::shared_ptr<Connection>) {
-        debug2("<TCP::Connection::@Connect> Connected.\n");
-      };
+      /*
+        Update TS.Recent from the current segment [RFC 7323 p. 16]
+      */
+      inline void update_ts_recent(TCP::Packet_ptr in) {
+        if(ts.seen and !seq_lt(ts.val, ts.recent) and seq_leq(in->seq(), ts.last_ack_sent))
+          ts.recent = ts.val;
+      }
 
-      /* When Connection is CLOSING. */
-      DisconnectCallback on_disconnect_ = [](std::shared_ptr<Connection>, Disconnect) {
-        //debug2("<TCP::Connection::@Disconnect> Connection disconnect. Reason: %s \n", msg.c_str());
-      };
 
-      /* When error occcured. */
-      ErrorCallback on_error_ = ErrorCallback::from<Connection,&Connection::default_on_error>(this);
-      inline void default_on_error(std::shared_ptr<Connection>, TCPException) {
-        //debug2("<TCP::Connection::@Error> TCPException: %s \n", error.what());
-      }
+      /// CALLBACK HANDLING ///
 
-      /* When packet is received */
-      PacketReceivedCallback on_packet_received_ = [](std::shared_ptr<Connection>, TCP::Packet_ptr) {
-        //debug2("<TCP::Connection::@PacketReceived> Packet received: %s \n", packet->to_string().c_str());
-      };
+      static bool default_on_accept(std::shared_ptr<Connection>)
+      { return true; } // Always accept
+
+      static void default_on_connect(std::shared_ptr<Connection>)
+      { debug2("<TCP::Connection::@Connect> Connected.\n"); }
+
+      static void default_on_disconnect(std::shared_ptr<Connection>, Disconnect) {}
+
+      static void default_on_error(std::shared_ptr<Connection>, TCPException) {}
 
-      /* When a packet is dropped. */
-      PacketDroppedCallback on_packet_dropped_ = [](TCP::Packet_ptr, std::string) {
-        //debug("<TCP::Connection::@PacketDropped> Packet dropped. %s | Reason: %s \n",
-        //      packet->to_string().c_str(), reason.c_str());
+      static void default_on_packet_received(std::shared_ptr<Connection>, TCP::Packet_ptr) {}
+
+      static void default_on_packet_dropped(TCP::Packet_ptr, std::string) {}
+
+      /*
+        The user callbacks. Shared by a listener and the connections it
+        accepts, until one of them sets its own (copy on write).
+      */
+      struct Callbacks {
+        /* When a Connection is initiated. */
+        AcceptCallback on_accept = AcceptCallback::from<&Connection::default_on_accept>();
+
+        /* When Connection is ESTABLISHED. */
+        ConnectCallback on_connect = ConnectCallback::from<&Connection::default_on_connect>();
+
+        /* When Connection is CLOSING. */
+        DisconnectCallback on_disconnect = DisconnectCallback::from<&Connection::default_on_disconnect>();
+
+        /* When error occcured. */
+        ErrorCallback on_error = ErrorCallback::from<&Connection::default_on_error>();
+
+        /* When packet is received */
+        PacketReceivedCallback on_packet_received = PacketReceivedCallback::from<&Connection::default_on_packet_received>();
+
+        /* When a packet is dropped. */
+        PacketDroppedCallback on_packet_dropped = PacketDroppedCallback::from<&Connection::default_on_packet_dropped>();
       };
+      std::shared_ptr<Callbacks> callbacks_;
+
+      /*
+        The defaults, shared by every connection that doesn't set its own.
+      */
+      static const std::shared_ptr<Callbacks>& default_callbacks();
+
+      /*
+        The callbacks of this connection only, for changing them.
+      */
+      inline Callbacks& callbacks() {
+        if(callbacks_.use_count() > 1)
+          callbacks_ = std::make_shared<Callbacks>(*callbacks_);
+        return *callbacks_;
+      }
 
 
       /// READING ///
@@ -1395,7 +2489,7 @@ namespace net {
         Assign the read request (read buffer)
       */
       inline void receive(ReadBuffer& buffer) {
-        read_request.buffer = {buffer};
+        cold().read_request.buffer = {buffer};
       }
 
       /*
@@ -1403,11 +2497,38 @@ namespace net {
       */
       size_t receive(const uint8_t* data, size_t n, bool PUSH);
 
+      /*
+        Accept in-order data; advance RCV.NXT and hand it to the read request.
+      */
+      void receive_in_order(Packet_ptr packet, const uint8_t* data, size_t n, bool PUSH);
+
+      /*
+        Chain payload for the zero-copy read request, taking it from the receive window.
+        Delivered on PUSH or when the requested amount is reached.
+      */
+      void receive_payload(Packet_ptr packet, const uint8_t* data, size_t n, bool PUSH);
+
+      /*
+        Hand the pending payload chain to the user.
+      */
+      void deliver_payload();
+
+      /*
+        The user let go of received payload; reopen the window.
+      */
+      void release_payload(uint32_t bytes);
+
+      /*
+        Accept everything in the reassembly queue that is now in order.
+      */
+      void drain_reassembly_queue();
+
       /*
         Copy data into the ReadBuffer
       */
       inline size_t receive(ReadBuffer& buf, const uint8_t* data, size_t n) {
         auto received = std::min(n, buf.remaining);
+        buf.allocate();
         memcpy(buf.pos(), data, received); // Can we use move?
         return received;
       }
@@ -1417,10 +2538,10 @@ namespace net {
         Returns receive buffer to user.
       */
       inline void receive_disconnect() {
-        assert(!read_request.buffer.empty());
-        auto& buf = read_request.buffer;
+        assert(cold_ and !cold_->read_request.buffer.empty());
+        auto& buf = cold_->read_request.buffer;
         buf.push = true;
-        read_request.callback(buf.buffer, buf.size());
+        cold_->read_request.callback(buf.buffer, buf.size());
       }
 
 
@@ -1487,17 +2608,40 @@ namespace net {
       /*
         Invoke/signal the diffrent TCP events.
       */
-      inline bool signal_accept() { return on_accept_(shared_from_this()); }
+      inline bool signal_accept() { return callbacks_->on_accept(shared_from_this()); }
+
+      inline void signal_connect() { callbacks_->on_connect(shared_from_this()); }
+
+      /*
+        Established: signal connect, or for a connection a listener
+        accepted, see if it's to wait for data or in the accept queue.
+      */
+      void signal_established();
+
+      /*
+        Give an accepted connection to the application, or its listener's queue.
+      */
+      void hand_over();
+
+      /*
+        Listening: no room for more established connections.
+      */
+      inline bool accept_queue_full() const
+      { return cold_ and cold_->backlog and cold_->accept_queue.size() >= cold_->backlog; }
 
-      inline void signal_connect() { on_connect_(shared_from_this()); }
+      // not for a connection the application never got
+      inline void signal_disconnect(Disconnect::Reason&& reason) {
+        if(accept_ == Accept::done)
+          callbacks_->on_disconnect(shared_from_this(), Disconnect{reason});
+      }
 
-      inline void signal_disconnect(Disconnect::Reason&& reason) { on_disconnect_(shared_from_this(), Disconnect{reason}); }
+      inline void signal_error(TCPException error) { callbacks_->on_error(shared_from_this(), error); }
 
-      inline void signal_error(TCPException error) { on_error_(shared_from_this(), error); }
+      inline void signal_error(Error err) { signal_error(TCPException{error_string(err)}); }
 
-      inline void signal_packet_received(TCP::Packet_ptr packet) { on_packet_received_(shared_from_this(), packet); }
+      inline void signal_packet_received(TCP::Packet_ptr packet) { callbacks_->on_packet_received(shared_from_this(), packet); }
 
-      inline void signal_packet_dropped(TCP::Packet_ptr packet, std::string reason) { on_packet_dropped_(packet, reason); }
+      inline void signal_packet_dropped(TCP::Packet_ptr packet, std::string reason) { callbacks_->on_packet_dropped(packet, reason); }
 
       /*
         Drop a packet. Used for debug/callback.
@@ -1527,12 +2671,26 @@ namespace net {
       }
 
       /*
-
-        Note:
-        Made a function due to future use when Window Scaling Option is added.
+        The window we're allowed to send within (already scaled).
       */
       inline uint32_t send_window() const {
-        return std::min((uint32_t)cb.SND.WND, cb.cwnd);
+        return std::min(cb.SND.WND, cb.cwnd);
+      }
+
+      /*
+        The window in an incoming segment, scaled.
+        The window of a SYN is never scaled [RFC 7323 p. 9]
+      */
+      inline uint32_t segment_window(TCP::Packet_ptr in) const {
+        return in->isset(SYN) ? in->win() : (uint32_t)in->win() << cb.SND.wind_shift;
+      }
+
+      /*
+        The window to advertise (RCV.WND, scaled down).
+      */
+      inline uint16_t advertised_window(bool syn = false) const {
+        auto wnd = syn ? cb.RCV.WND : cb.RCV.WND >> cb.RCV.wind_shift;
+        return std::min(wnd, (uint32_t)TCP::default_window_size);
       }
 
       inline int32_t congestion_window() const {
@@ -1561,6 +2719,38 @@ namespace net {
       */
       bool can_send();
 
+      /*
+        Paced, and the rate allows nothing more right now. Puts the
+        connection on the TCP's pacing list, to try again later.
+      */
+      bool pacing_hold();
+
+      /// Nagle [RFC 896] [RFC 1122 p. 98] ///
+
+      bool nodelay_ : 1;
+
+      bool corked_ : 1;
+
+      /*
+        The payload of a full-sized segment, less the options every segment carries.
+      */
+      inline uint16_t effective_mss() const
+      { return SMSS() - (ts.ok ? sizeof(Option::opt_timestamp) : 0); }
+
+      /*
+        A segment smaller than the MSS may only go out when nothing is in
+        flight, unless NODELAY. Never while corked.
+      */
+      inline bool may_send_small() const
+      { return !corked_ and (nodelay_ or flight_size() == 0); }
+
+      /*
+        Fill a packet with as much queued data as fits, coalesced from as many
+        write requests as needed, and give it the next SEQ number.
+        The write queue is advanced by the caller, after transmitting.
+      */
+      size_t fill_from_writeq(Packet_ptr);
+
       /*
         Send as much as possible from write queue.
       */
@@ -1574,25 +2764,142 @@ namespace net {
       /// Congestion Control [RFC 5681] ///
 
       // is fast recovery state
-      bool fast_recovery = false;
+      bool fast_recovery : 1;
 
       // First partial ack seen
-      bool reno_fpack_seen = false;
+      bool reno_fpack_seen : 1;
 
       // limited transmit [RFC 3042] active
-      bool limited_tx_ = true;
+      bool limited_tx_ : 1;
+
+      /// Selective Acknowledgement [RFC 2018] [RFC 6675] ///
+
+      // both ends are SACK capable
+      bool sack_perm : 1;
+
+      /// Window Scaling [RFC 7323] ///
+
+      // the remote sent a window scale option
+      bool wscale_perm : 1;
+
+      /// SYN cookies [RFC 4987] ///
 
-      // number of duplicate acks
-      size_t dup_acks_ = 0;
+      // set up from a cookie: the TSval in our SYN-ACK was backdated
+      bool syn_cookie : 1;
+
+      /// Explicit Congestion Notification [RFC 3168] ///
+
+      // both ends do ECN
+      bool ecn_ok : 1;
+      // CE arrived, ECE goes out until the peer sends CWR
+      bool ecn_echo : 1;
+      // cwnd went down for ECE, the next new segment says CWR
+      bool ecn_cwr : 1;
+      // cwnd went down for ECE, not again before Cold::ecn_end is ACKed
+      bool ecn_cut : 1;
+
+      /*
+        An arriving segment: note CE, and CWR from the peer.
+      */
+      void ecn_received(TCP::Packet_ptr);
+
+      /*
+        A new data segment: ECT, and CWR if it's due.
+      */
+      void ecn_mark(TCP::Packet_ptr);
+
+      /*
+        Handing a passively opened connection over to the application:
+        pending until established, then deferred (waiting for data) or
+        queued on the listener, until done. Data arriving before it's
+        done is held for the first read.
+      */
+      enum class Accept : uint8_t { done, pending, deferred, queued };
+      Accept accept_ = Accept::done;
 
       Seq prev_highest_ack_ = 0;
       Seq highest_ack_ = 0;
 
-      // number of non duplicate acks received
-      size_t acks_rcvd_ = 0;
+      /*
+        Receive window auto-tuning, see Cold::rcv_tune.
+      */
+      void tune_receive_window(uint32_t consumed);
+
+      // what the receiver holds above SND.UNA
+      Scoreboard scoreboard;
+
+      // highest sequence retransmitted during recovery (HighRxt)
+      Seq high_rxt = 0;
+
+      /*
+        Bytes considered in flight during SACK recovery (SetPipe).
+      */
+      uint32_t sack_pipe() const;
+
+      /*
+        The next hole above HighRxt to retransmit (NextSeg rule 1 and 3).
+        Returns false if there is none, and sets lost if rule 1 applies.
+      */
+      bool sack_next_hole(Seq& seq, uint32_t& len, bool& lost) const;
+
+      /*
+        Send as much as the pipe allows, holes first.
+      */
+      void sack_send();
+
+      /*
+        Enter loss recovery [RFC 6675 p. 8]
+      */
+      void sack_enter_recovery();
+
+      /*
+        What to do on a duplicate ACK when SACK is in use.
+      */
+      void sack_on_dup_ack();
+
+      /*
+        Send an ACK for RCV.NXT, with SACK blocks if anything is queued out of order.
+      */
+      void send_ack();
+
+      /// Delayed ACK [RFC 1122 p. 96] [RFC 5681 p. 11] ///
+
+      static constexpr uint32_t delack_ms = 40;
+
+      struct {
+        hw::PIT::Timer_iterator iter;
+        bool active = false;
+        bool quick = false;     // never delay
+        uint16_t quickacks = 0; // segments left to ACK right away
+        uint16_t rcv_mss = 0;   // largest segment received
+        Seq acked = 0;          // ACK in the last segment sent
+      } delack;
+
+      /*
+        In-order data of length arrived. ACK it now, or at least every
+        second full-sized segment, or when the delayed ACK timer fires.
+      */
+      void ack_data(uint16_t length, bool now);
+
+      /*
+        An ACK went out (on its own, or with data). Nothing is delayed anymore.
+      */
+      inline void ack_sent(TCP::Packet_ptr packet) {
+        if(!packet->isset(ACK))
+          return;
+        delack.acked = packet->ack();
+        if(delack.active and delack.acked == cb.RCV.NXT)
+          delack_stop();
+      }
+
+      void delack_start();
 
-      inline void setup_congestion_control()
-      { reno_init(); }
+      void delack_stop();
+
+      /*
+        Create the stack's congestion control algorithm.
+      */
+      void setup_congestion_control();
 
       inline uint16_t SMSS() const
       { return host_.MSS(); }
@@ -1603,58 +2910,37 @@ namespace net {
       inline uint32_t flight_size() const
       { return (uint64_t)cb.SND.NXT - (uint64_t)cb.SND.UNA; }
 
-      /// Reno ///
-
-      inline void reno_init() {
-        reno_init_cwnd(3);
-        reno_init_sshtresh();
-      }
+      /// Congestion control ///
 
-      inline void reno_init_cwnd(size_t segments)
-      {
-        cb.cwnd = segments*SMSS();
-        debug2("<TCP::Connection::reno_init_cwnd> Cwnd initilized: %u\n", cb.cwnd);
-      }
-
-      inline void reno_init_sshtresh()
-      { cb.ssthresh = cb.SND.WND; }
+      /*
+        Owns the algorithm, unless it's the shared NewReno.
+      */
+      struct Cc_deleter {
+        void operator()(Congestion_control*) const;
+      };
+      std::unique_ptr<Congestion_control, Cc_deleter> cc_;
 
+      void use_congestion_control(Congestion_control*);
 
-      inline void reno_increase_cwnd(uint16_t n)
-      { cb.cwnd += std::min(n, SMSS()); }
+      /// Reno ///
 
       inline void reno_deflate_cwnd(uint16_t n)
       { cb.cwnd -= (n >= SMSS()) ? n-SMSS() : n; }
 
-      inline void reduce_ssthresh() {
-        auto fs = flight_size();
-        debug2("<Connection::reduce_ssthresh> FlightSize: %u\n", fs);
-
-        auto two_seg = 2*(uint32_t)SMSS();
-
-        if(limited_tx_)
-          fs = (fs >= two_seg) ? fs - two_seg : 0;
-
-        cb.ssthresh = std::max( (fs / 2), two_seg );
-        debug2("<TCP::Connection::reduce_ssthresh> Slow start threshold reduced: %u\n",
-          cb.ssthresh);
-      }
-
       inline void fast_retransmit() {
         debug("<TCP::Connection::fast_retransmit> Fast retransmit initiated.\n");
-        // reduce sshtresh
-        reduce_ssthresh();
+        cc_->on_loss(*this);
         // retransmit segment starting SND.UNA
         retransmit();
         // inflate congestion window with the 3 packets we got dup ack on.
-        cb.cwnd = cb.ssthresh + 3*SMSS();
+        cb.cwnd += 3*SMSS();
         fast_recovery = true;
       }
 
       inline void finish_fast_recovery() {
         reno_fpack_seen = false;
         fast_recovery = false;
-        cb.cwnd = std::min(cb.ssthresh, std::max(flight_size(), (uint32_t)SMSS()) + SMSS());
+        cc_->on_recovery_done(*this);
         debug("<TCP::Connection::finish_fast_recovery> Finished Fast Recovery - Cwnd: %u\n", cb.cwnd);
       }
 
@@ -1664,7 +2950,7 @@ namespace net {
       /*
         Generate a new ISS.
       */
-      TCP::Seq generate_iss();
+      TCP::Seq generate_iss() const;
 
 
       /// STATE HANDLING ///
@@ -1699,7 +2985,13 @@ namespace net {
       /*
         Retransmit the first packet in retransmission queue.
       */
-      void retransmit();
+      inline void retransmit()
+      { retransmit(writeq_start(), SMSS()); }
+
+      /*
+        Retransmit at most len bytes from seq. Returns the bytes sent.
+      */
+      size_t retransmit(Seq seq, size_t len);
 
       /*
         Start retransmission timer.
@@ -1722,7 +3014,12 @@ namespace net {
       /*
         Number of retransmission attempts on the packet first in RT-queue
       */
-      size_t rto_attempt = 0;
+      uint16_t rto_attempt = 0;
+
+      /*
+        Number of duplicate acks
+      */
+      uint16_t dup_acks_ = 0;
 
       /*
         Remove all packets acknowledge by ACK in retransmission queue
@@ -1741,10 +3038,35 @@ namespace net {
 
 
       /*
-        Start the time wait timeout for 2*MSL
+        Enter TIME-WAIT: the host keeps a small record for 2*MSL,
+        and this connection is done.
       */
       void start_time_wait_timeout();
 
+      /// KEEPALIVE & IDLE TIMEOUT ///
+
+      /*
+        Put the connection on the idle wheel, if connected and
+        there's a keepalive or idle timeout to keep track of.
+      */
+      void idle_arm();
+
+      /*
+        Seconds until the next keepalive or timeout is due, after being idle for so long.
+      */
+      uint32_t idle_next(uint16_t idle) const;
+
+      /*
+        Called from the idle wheel: time out or probe, if due.
+        Returns the seconds until the next check, or 0 to leave the wheel.
+      */
+      uint32_t idle_check(uint32_t now);
+
+      /*
+        Send a keepalive: an old sequence number, which the peer will ACK [RFC 1122 4.2.3.6].
+      */
+      void send_keepalive();
+
       /*
         Tell the host (TCP) to delete this connection.
       */
@@ -1787,9 +3109,16 @@ namespace net {
 
     /*
       Bind a new listener to a given Port.
+
+      Throws TCPException if the port is taken, see try_bind().
     */
     TCP::Connection& bind(Port port);
 
+    /*
+      Bind a new listener to a given Port, or tell why not.
+    */
+    Expected<Connection*> try_bind(Port port);
+
     /*
       Active open a new connection to the given remote.
     */
@@ -1807,6 +3136,19 @@ namespace net {
     */
     void connect(Socket remote, Connection::ConnectCallback);
 
+    /*
+      Active open a new connection to the given remote, with the first write
+      already queued. It goes in the SYN when there's a Fast Open cookie for
+      the remote [RFC 7413], and after the handshake otherwise.
+    */
+    Connection_ptr connect(Socket remote, buffer_t data, size_t n, Connection::WriteCallback);
+
+    /*
+      Fast Open cookies the client side holds, one per remote address.
+    */
+    inline size_t fastopen_cached() const
+    { return fastopen_cache_.size(); }
+
     /*
       Receive packet from network layer (IP).
     */
@@ -1829,13 +3171,18 @@ namespace net {
     /*
       Number of open ports.
     */
-    inline size_t openPorts() { return listeners_.size(); }
+    inline size_t openPorts() { return listener_count_; }
 
     /*
       Number of active connections.
     */
     inline size_t activeConnections() { return connections_.size(); }
 
+    /*
+      Connections closed, but remembered for 2*MSL [RFC 793].
+    */
+    inline size_t time_wait_count() const { return time_wait_.size(); }
+
     /*
       Maximum Segment Lifetime
     */
@@ -1848,6 +3195,83 @@ namespace net {
       MAX_SEG_LIFETIME = msl;
     }
 
+    /*
+      Congestion control for new connections.
+    */
+    inline void set_congestion_control(Congestion cc)
+    { congestion_ = cc; }
+
+    inline Congestion congestion_control() const
+    { return congestion_; }
+
+    /*
+      Explicit Congestion Notification [RFC 3168] for new connections:
+      offered on SYN, and taken when the peer offers it. Off by default.
+    */
+    inline void set_ecn(bool on)
+    { ecn_ = on; }
+
+    inline bool ecn() const
+    { return ecn_; }
+
+    /*
+      Transmit scheduling.
+
+      Connections waiting for room in the transmit queue are served
+      deficit round-robin: each round a connection may send up to
+      quantum * weight packets, and what it couldn't use of its turn
+      (for lack of packets) is kept for the next.
+    */
+    struct Tx_stats {
+      uint64_t rounds = 0;      // turns given
+      uint64_t packets = 0;     // data packets sent
+      uint64_t deferred = 0;    // turns cut short by a full transmit queue
+      size_t max_queued = 0;    // most connections waiting at once
+    };
+
+    inline void set_tx_quantum(uint16_t packets) {
+      Expects(packets > 0);
+      tx_quantum_ = packets;
+    }
+
+    inline uint16_t tx_quantum() const
+    { return tx_quantum_; }
+
+    inline const Tx_stats& tx_stats() const
+    { return tx_stats_; }
+
+    /*
+      Jain's fairness index over the packets sent per connection,
+      scaled by weight: 1.0 is perfectly fair, 1/n is one connection
+      taking it all. Only connections that sent something count.
+    */
+    double tx_fairness() const;
+
+    void reset_tx_stats();
+
+    /*
+      Keepalive timing, for connections with keepalive on: after idle
+      seconds without a segment from the peer, send a probe every
+      interval, and reset the connection when probes go unanswered.
+      Defaults to two hours, 75 seconds and 9 probes [RFC 1122 4.2.3.6].
+    */
+    void set_keepalive(std::chrono::seconds idle, std::chrono::seconds interval, uint8_t probes);
+
+    inline std::chrono::seconds keepalive_idle() const
+    { return std::chrono::seconds(keepalive_idle_); }
+
+    inline std::chrono::seconds keepalive_interval() const
+    { return std::chrono::seconds(keepalive_interval_); }
+
+    inline uint8_t keepalive_probes() const
+    { return keepalive_probes_; }
+
+    /*
+      Connections on the idle wheel, i.e. with keepalive or an idle timeout.
+    */
+    inline size_t idle_count() const
+    { return idle_armed_; }
+
     /*
       Maximum Segment Size
       [RFC 793] [RFC 879] [RFC 6691]
@@ -1870,31 +3294,120 @@ namespace net {
   private:
 
     IPStack& inet_;
-    std::map<TCP::Port, Connection> listeners_;
-    std::map<Connection::Tuple, Connection_ptr> connections_;
+    /*
+      Listeners, indexed by port.
+    */
+    std::vector<std::unique_ptr<Connection>> listeners_;
+    size_t listener_count_ = 0;
+    Connection_table<Connection::Tuple, Connection_ptr> connections_;
 
     downstream _network_layer_out;
 
+    /*
+      Connections waiting for the transmit queue, served round-robin.
+    */
     std::deque<Connection_ptr> writeq;
+    uint16_t tx_quantum_ = default_tx_quantum;
+    bool tx_resume_ = false;  // the front connection's turn isn't over
+    bool tx_busy_ = false;
+    Tx_stats tx_stats_;
 
-    std::vector<Port> used_ports;
+    /*
+      Paced connections waiting for the rate to allow more, tried
+      again on the next tick of a millisecond timer.
+    */
+    std::vector<std::weak_ptr<Connection>> paced_;
+    bool pacing_timer_active_ = false;
 
     /*
-      Settings
+      Ports used by listeners and outgoing connections.
     */
-    TCP::Port current_ephemeral_ = 1024;
+    Port_util used_ports;
 
     std::chrono::milliseconds MAX_SEG_LIFETIME;
 
+    Congestion congestion_ = NEWRENO;
+    bool ecn_ = false;
+
+    /*
+      Connection attempts waiting for the final ACK, and the timer
+      retransmitting their SYN-ACKs.
+    */
+    Connection_table<Connection::Tuple, Half_open> half_open_;
+    bool syn_timer_active_ = false;
+
+    /*
+      Key for the SYN cookie hash.
+    */
+    HalfSipHash::key_t cookie_key_;
+
+    /*
+      Key for the ISS hash.
+    */
+    HalfSipHash::key_t iss_key_;
+
+    /*
+      Fast Open cookies from servers, by address. Bounded, one
+      goes to make room for another.
+    */
+    static constexpr size_t fastopen_cache_max = 1024;
+    std::map<uint32_t, Fastopen_cookie> fastopen_cache_;
+
+    /*
+      What's left of a connection in TIME-WAIT: enough to ACK a
+      retransmitted FIN, and to tell a new SYN from an old duplicate.
+    */
+    struct Time_wait {
+      Seq snd_nxt = 0;
+      Seq rcv_nxt = 0;
+      uint32_t ts_recent = 0;
+      uint32_t expires = 0; // wheel tick
+      bool ts = false;
+    };
+
+    /*
+      TIME-WAIT records, expired by a timer wheel ticking once a second.
+      A record lives in slot (expires % slots), and goes around again if
+      it's not due yet.
+    */
+    static constexpr size_t time_wait_slots = 64;
+    Connection_table<Connection::Tuple, Time_wait> time_wait_;
+    std::array<std::vector<Connection::Tuple>, time_wait_slots> time_wait_wheel_;
+    uint32_t time_wait_tick_ = 0;
+    bool time_wait_timer_active_ = false;
+
+    /*
+      Keepalive and idle timeouts, on a timer wheel ticking once a
+      second while there's anything on it. A connection is only looked
+      at when its slot comes up, so traffic costs nothing but noting the
+      time; if it's not due yet (it got a segment, or it's more than a
+      turn away) it's moved on to the slot where it is.
+    */
+    static constexpr size_t idle_slots = 256;
+    std::array<std::vector<std::weak_ptr<Connection>>, idle_slots> idle_wheel_;
+    uint32_t idle_tick_ = 0;  // stands still while the wheel is empty
+    size_t idle_armed_ = 0;
+    bool idle_timer_active_ = false;
+
+    uint16_t keepalive_idle_ = 7200;
+    uint16_t keepalive_interval_ = 75;
+    uint8_t keepalive_probes_ = 9;
+
+    /*
+      Connections are allocated from a pool, they come and go all the time.
+    */
+    using Connection_allocator = Pool_allocator<Connection>;
+
     /*
       Transmit packet to network layer (IP).
     */
     void transmit(TCP::Packet_ptr);
 
     /*
-      Generate a unique initial sequence number (ISS).
+      Generate an initial sequence number (ISS) for a connection,
+      unpredictable to anyone off the path [RFC 6528].
     */
-    static TCP::Seq generate_iss();
+    TCP::Seq generate_iss(const Connection::Tuple&) const;
 
     /*
       Returns a free port for outgoing connections.
@@ -1904,7 +3417,9 @@ namespace net {
     /*
       Check if the port is in use either among "listeners" or "connections"
     */
-    bool port_in_use(const TCP::Port) const;
+    inline bool port_in_use(const TCP::Port port) const {
+      return used_ports.is_bound(port);
+    }
 
     /*
       Packet is dropped.
@@ -1921,6 +3436,36 @@ namespace net {
     */
     void close_connection(TCP::Connection&);
 
+    /*
+      Free the local port, unless a listener has it.
+    */
+    void release_port(Port);
+
+    /// TIME-WAIT ///
+
+    /*
+      Replace the connection with a Time_wait record.
+    */
+    void enter_time_wait(Connection&);
+
+    /*
+      A segment for a connection in TIME-WAIT.
+    */
+    void time_wait_segment(const Connection::Tuple&, Time_wait&, TCP::Packet_ptr);
+
+    void time_wait_arm(const Connection::Tuple&, Time_wait&);
+
+    void time_wait_timeout();
+
+    /// KEEPALIVE & IDLE TIMEOUT ///
+
+    /*
+      Put the connection on the idle wheel, to be checked in so many seconds (at least 1).
+    */
+    void idle_arm(Connection_ptr, uint32_t seconds);
+
+    void idle_timeout();
+
     /*
       Process the write queue with the given amount of free packets.
     */
@@ -1931,6 +3476,85 @@ namespace net {
     */
     size_t send(Connection_ptr, const char* buffer, size_t n);
 
+    /*
+      Queue the connection to send from its write queue, in turn.
+    */
+    void request_offer(Connection_ptr);
+
+    /*
+      Wait for the pacing rate, see Connection::pacing_hold.
+    */
+    void pace(Connection_ptr);
+
+    void pacing_timeout();
+
+    /// Passive open ///
+
+    /*
+      A SYN for a listener: keep a Half_open, or answer with a SYN cookie if the backlog is full.
+    */
+    void syn_received(Connection& listener, const Connection::Tuple&, TCP::Packet_ptr);
+
+    /*
+      The final ACK of a handshake: create the Connection.
+    */
+    void handshake_completed(Connection& listener, const Connection::Tuple&, TCP::Packet_ptr);
+
+    void send_synack(const Connection::Tuple&, const Half_open&, uint32_t ts_val,
+                     const Fastopen_cookie* cookie = nullptr);
+
+    /*
+      The options of a SYN that matter for the handshake.
+    */
+    static void parse_syn_options(TCP::Packet&, Half_open&, uint32_t* ts_ecr = nullptr,
+                                  Fastopen_cookie* cookie = nullptr);
+
+    /*
+      Reply to a segment no connection wants.
+    */
+    void send_reset(TCP::Packet_ptr in);
+
+    /*
+      Retransmit SYN-ACKs, and forget attempts that never completed.
+    */
+    void syn_timeout();
+
+    /// SYN cookies ///
+
+    /*
+      The MSS values a cookie can encode, by index.
+    */
+    static constexpr uint16_t syn_cookie_mss[8] { 536, 1200, 1360, 1400, 1440, 1452, 1460, 8960 };
+
+    /*
+      ISS = time (5 bits) | MSS index (3 bits) | keyed hash (24 bits)
+    */
+    Seq syn_cookie(const Connection::Tuple&, Seq irs, uint32_t time, uint8_t mss_index) const;
+
+    /*
+      Is the ACK for a cookie we sent recently, and what was in the SYN.
+    */
+    bool syn_cookie_valid(const Connection::Tuple&, TCP::Packet_ptr ack, Half_open&) const;
+
+    /// TCP Fast Open [RFC 7413] ///
+
+    /*
+      The cookie for a client: a keyed hash of its address.
+    */
+    void fastopen_cookie(Address, Fastopen_cookie&) const;
+
+    /*
+      A SYN with a valid cookie and data: create the Connection right away.
+    */
+    void fastopen_accept(Connection& listener, const Connection::Tuple&, Half_open&, TCP::Packet_ptr syn);
+
+    /*
+      Client side: the cookie for a server, nullptr if there's none.
+    */
+    const Fastopen_cookie* fastopen_lookup(Address) const;
+
+    void fastopen_remember(Address, const uint8_t* cookie, uint8_t length);
+
     /*
       Force the TCP to process the it's queue with the current amount of available packets.
     */
@@ -1945,6 +3569,14 @@ namespace net {
 
   }; // < class TCP
 
+  /*
+    There may be a million of them: keep an idle connection (no reader,
+    nothing queued) to what's in the object itself, under 256 bytes on
+    the heap. The pool hands out the object and the shared_ptr control
+    block (12 bytes) together, and malloc adds 4 and rounds up to 8.
+  */
+  static_assert(sizeof(TCP::Connection) <= 232, "TCP::Connection has grown past 232 bytes");
+
 }; // < namespace net
 
 #endif
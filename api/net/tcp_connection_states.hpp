@@ -34,9 +34,9 @@ public:
     return instance;
   }
 
-  virtual void open(Connection&, bool active = false) override;
+  virtual Error open(Connection&, bool active = false) override;
 
-  virtual size_t send(Connection&, WriteBuffer&) override;
+  virtual Expected<size_t> send(Connection&, WriteBuffer&) override;
 
   /*
     PASSIVE:
@@ -67,11 +67,11 @@ public:
     static Listen instance;
     return instance;
   }
-  virtual void open(Connection&, bool active = false) override;
+  virtual Error open(Connection&, bool active = false) override;
 
-  virtual size_t send(Connection&, WriteBuffer&) override;
+  virtual Expected<size_t> send(Connection&, WriteBuffer&) override;
 
-  virtual void close(Connection&) override;
+  virtual Error close(Connection&) override;
   /*
     -> Receive SYN.
 
@@ -98,9 +98,9 @@ public:
     return instance;
   }
 
-  virtual size_t send(Connection&, WriteBuffer&) override;
+  virtual Expected<size_t> send(Connection&, WriteBuffer&) override;
 
-  virtual void close(Connection&) override;
+  virtual Error close(Connection&) override;
   /*
     -> Receive SYN+ACK
 
@@ -127,9 +127,11 @@ public:
     return instance;
   }
 
-  virtual size_t send(Connection&, WriteBuffer&) override;
+  virtual Expected<size_t> send(Connection&, WriteBuffer&) override;
 
-  virtual void close(Connection&) override;
+  virtual Error receive(Connection&, ReadBuffer&) override;
+
+  virtual Error close(Connection&) override;
 
   virtual void abort(Connection&) override;
   /*
@@ -159,11 +161,11 @@ public:
     return instance;
   }
 
-  virtual size_t send(Connection&, WriteBuffer&) override;
+  virtual Expected<size_t> send(Connection&, WriteBuffer&) override;
 
-  virtual void receive(Connection&, ReadBuffer&) override;
+  virtual Error receive(Connection&, ReadBuffer&) override;
 
-  virtual void close(Connection&) override;
+  virtual Error close(Connection&) override;
 
   virtual void abort(Connection&) override;
 
@@ -199,9 +201,9 @@ public:
     return instance;
   }
 
-  virtual void receive(Connection&, ReadBuffer&) override;
+  virtual Error receive(Connection&, ReadBuffer&) override;
 
-  virtual void close(Connection&) override;
+  virtual Error close(Connection&) override;
 
   virtual void abort(Connection&) override;
 
@@ -238,9 +240,9 @@ public:
     return instance;
   }
 
-  virtual void receive(Connection&, ReadBuffer&) override;
+  virtual Error receive(Connection&, ReadBuffer&) override;
 
-  virtual void close(Connection&) override;
+  virtual Error close(Connection&) override;
 
   virtual void abort(Connection&) override;
   /*
@@ -274,11 +276,11 @@ public:
     return instance;
   }
 
-  virtual size_t send(Connection&, WriteBuffer&) override;
+  virtual Expected<size_t> send(Connection&, WriteBuffer&) override;
 
-  virtual void receive(Connection&, ReadBuffer&) override;
+  virtual Error receive(Connection&, ReadBuffer&) override;
 
-  virtual void close(Connection&) override;
+  virtual Error close(Connection&) override;
 
   virtual void abort(Connection&) override;
   /*
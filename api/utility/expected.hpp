@@ -0,0 +1,71 @@
+// This file is a part of the IncludeOS unikernel - www.includeos.org
+//
+// Copyright 2015 Oslo and Akershus University College of Applied Sciences
+// and Alfred Bratterud
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef UTILITY_EXPECTED_HPP
+#define UTILITY_EXPECTED_HPP
+
+#include <cassert>
+#include <utility>
+
+/**
+ *  A value, or the error telling why there is none
+ *
+ *  For failures that are part of normal operation, where unwinding an
+ *  exception would cost far more than the work itself. Both are kept
+ *  inline, so T and E should be small, default constructible and of
+ *  different types.
+ */
+template <typename T, typename E>
+class Expected {
+public:
+  Expected(T value) noexcept
+    : value_(std::move(value)), error_(), ok_(true) {}
+
+  Expected(E error) noexcept
+    : value_(), error_(error), ok_(false) {}
+
+  explicit operator bool() const noexcept
+  { return ok_; }
+
+  bool has_value() const noexcept
+  { return ok_; }
+
+  T& value() noexcept
+  { assert(ok_); return value_; }
+
+  const T& value() const noexcept
+  { assert(ok_); return value_; }
+
+  T value_or(T other) const noexcept
+  { return ok_ ? value_ : other; }
+
+  T& operator*() noexcept
+  { return value(); }
+
+  T* operator->() noexcept
+  { return &value(); }
+
+  E error() const noexcept
+  { assert(not ok_); return error_; }
+
+private:
+  T    value_;
+  E    error_;
+  bool ok_;
+}; //< class Expected
+
+#endif //< UTILITY_EXPECTED_HPP
@@ -0,0 +1,107 @@
+// This file is a part of the IncludeOS unikernel - www.includeos.org
+//
+// Copyright 2015 Oslo and Akershus University College of Applied Sciences
+// and Alfred Bratterud
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef UTILITY_LAZY_DEQUE_HPP
+#define UTILITY_LAZY_DEQUE_HPP
+
+#include <deque>
+#include <memory>
+
+/**
+ *  A std::deque that only exists while it holds something
+ *
+ *  One pointer when empty. The deque is allocated on the first insert,
+ *  and freed again when pop_front() or clear() empties it, so objects
+ *  that are idle most of the time don't carry queue storage around.
+ *
+ *  @note Iterators are invalidated when the deque is freed.
+ */
+template <typename T>
+class Lazy_deque {
+public:
+  using container = std::deque<T>;
+  using iterator = typename container::iterator;
+  using const_iterator = typename container::const_iterator;
+
+  bool empty() const noexcept
+  { return not d_ or d_->empty(); }
+
+  size_t size() const noexcept
+  { return d_ ? d_->size() : 0; }
+
+  T& front() { return d_->front(); }
+  const T& front() const { return d_->front(); }
+
+  T& back() { return d_->back(); }
+  const T& back() const { return d_->back(); }
+
+  T& operator[](size_t i) { return (*d_)[i]; }
+  const T& operator[](size_t i) const { return (*d_)[i]; }
+
+  iterator begin() { return get().begin(); }
+  iterator end() { return get().end(); }
+  const_iterator begin() const { return get().begin(); }
+  const_iterator end() const { return get().end(); }
+
+  void push_back(const T& value)
+  { alloc().push_back(value); }
+
+  void pop_front() {
+    d_->pop_front();
+    if (d_->empty())
+      d_.reset();
+  }
+
+  iterator erase(iterator it)
+  { return d_->erase(it); }
+
+  iterator erase(iterator first, iterator last) {
+    // without a deque, the range can only be empty
+    if (first == last)
+      return last;
+    return d_->erase(first, last);
+  }
+
+  iterator insert(iterator pos, const T& value) {
+    // without a deque, pos can only be end()
+    if (not d_)
+      return alloc().insert(d_->end(), value);
+    return d_->insert(pos, value);
+  }
+
+  void clear() noexcept
+  { d_.reset(); }
+
+private:
+  std::unique_ptr<container> d_;
+
+  container& alloc() {
+    if (not d_)
+      d_.reset(new container);
+    return *d_;
+  }
+
+  container& get() const
+  { return d_ ? *d_ : none(); }
+
+  static container& none() {
+    static container empty;
+    return empty;
+  }
+}; //< class Lazy_deque
+
+#endif //< UTILITY_LAZY_DEQUE_HPP
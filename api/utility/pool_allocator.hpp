@@ -0,0 +1,88 @@
+// This file is a part of the IncludeOS unikernel - www.includeos.org
+//
+// Copyright 2015 Oslo and Akershus University College of Applied Sciences
+// and Alfred Bratterud
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef UTILITY_POOL_ALLOCATOR_HPP
+#define UTILITY_POOL_ALLOCATOR_HPP
+
+#include <cstddef>
+#include <new>
+#include <vector>
+
+/**
+ *  An allocator keeping up to @Max freed blocks around for reuse
+ *
+ *  For objects that come and go all the time, like connections, so most
+ *  allocations are a pop from a free list. There's one list per type,
+ *  after rebinding, so std::allocate_shared gets one for its control
+ *  block and object together.
+ */
+template <typename T, size_t Max = 1024>
+class Pool_allocator {
+public:
+  using value_type = T;
+
+  template <typename U>
+  struct rebind { using other = Pool_allocator<U, Max>; };
+
+  Pool_allocator() noexcept = default;
+
+  template <typename U>
+  Pool_allocator(const Pool_allocator<U, Max>&) noexcept {}
+
+  T* allocate(size_t n) {
+    auto& list = free_list();
+    if (n == 1 and not list.empty()) {
+      void* p = list.back();
+      list.pop_back();
+      return static_cast<T*>(p);
+    }
+    return static_cast<T*>(::operator new(n * sizeof(T)));
+  }
+
+  void deallocate(T* p, size_t n) noexcept {
+    auto& list = free_list();
+    // never grows, the room is reserved up front
+    if (n == 1 and list.size() < Max)
+      list.push_back(p);
+    else
+      ::operator delete(p);
+  }
+
+  /** Blocks ready for reuse */
+  static size_t pooled() noexcept
+  { return free_list().size(); }
+
+private:
+  static std::vector<void*>& free_list() {
+    static std::vector<void*> list = [] {
+      std::vector<void*> v;
+      v.reserve(Max);
+      return v;
+    }();
+    return list;
+  }
+}; //< class Pool_allocator
+
+template <typename T, typename U, size_t Max>
+bool operator==(const Pool_allocator<T, Max>&, const Pool_allocator<U, Max>&) noexcept
+{ return true; }
+
+template <typename T, typename U, size_t Max>
+bool operator!=(const Pool_allocator<T, Max>&, const Pool_allocator<U, Max>&) noexcept
+{ return false; }
+
+#endif //< UTILITY_POOL_ALLOCATOR_HPP
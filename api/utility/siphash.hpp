@@ -0,0 +1,75 @@
+// This file is a part of the IncludeOS unikernel - www.includeos.org
+//
+// Copyright 2015 Oslo and Akershus University College of Applied Sciences
+// and Alfred Bratterud
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef UTILITY_SIPHASH_HPP
+#define UTILITY_SIPHASH_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ *  HalfSipHash-1-3 (Aumasson & Bernstein), the 32-bit variant of SipHash
+ *
+ *  A keyed hash for hash tables holding keys an attacker can choose,
+ *  i.e. connection tuples. Works on whole 32-bit words, which is all
+ *  the network code needs.
+ */
+class HalfSipHash {
+public:
+  using key_t = uint32_t[2];
+
+  /** Hash @n words with the 64-bit key @k */
+  static uint32_t hash(const key_t& k, const uint32_t* words, size_t n) noexcept
+  {
+    uint32_t v0 = k[0];
+    uint32_t v1 = k[1];
+    uint32_t v2 = 0x6c796765 ^ k[0];
+    uint32_t v3 = 0x74656462 ^ k[1];
+
+    for (size_t i = 0; i < n; i++) {
+      v3 ^= words[i];
+      round(v0, v1, v2, v3);
+      v0 ^= words[i];
+    }
+
+    // Last block: the length in bytes, in the top byte
+    const uint32_t b = static_cast<uint32_t>(n * 4) << 24;
+    v3 ^= b;
+    round(v0, v1, v2, v3);
+    v0 ^= b;
+
+    v2 ^= 0xff;
+    round(v0, v1, v2, v3);
+    round(v0, v1, v2, v3);
+    round(v0, v1, v2, v3);
+    return v1 ^ v3;
+  }
+
+private:
+  static inline uint32_t rotl(uint32_t x, int b) noexcept
+  { return (x << b) | (x >> (32 - b)); }
+
+  static inline void round(uint32_t& v0, uint32_t& v1, uint32_t& v2, uint32_t& v3) noexcept
+  {
+    v0 += v1; v1 = rotl(v1, 5);  v1 ^= v0; v0 = rotl(v0, 16);
+    v2 += v3; v3 = rotl(v3, 8);  v3 ^= v2;
+    v0 += v3; v3 = rotl(v3, 7);  v3 ^= v0;
+    v2 += v1; v1 = rotl(v1, 13); v1 ^= v2; v2 = rotl(v2, 16);
+  }
+}; //< class HalfSipHash
+
+#endif //< UTILITY_SIPHASH_HPP
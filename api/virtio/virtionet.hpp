@@ -108,6 +108,9 @@
 #define VIRTIO_NET_S_LINK_UP  1
 #define VIRTIO_NET_S_ANNOUNCE 2
 
+// From Virtio 1.01, 5.1.6
+#define VIRTIO_NET_HDR_F_NEEDS_CSUM 1
+
 /** Virtio-net device driver.  */
 class VirtioNet : Virtio {
 
@@ -152,6 +155,10 @@ public:
     return tx_q.num_free() / 2;
   };
 
+  /** Whether the device finishes partial checksums (VIRTIO_NET_F_CSUM) */
+  inline bool checksum_offload() const noexcept
+  { return csum_offload_; }
+
   /** Number of incoming packets waiting in the RX-queue */
   inline size_t receive_queue_waiting(){
     return rx_q.new_incoming() / 2;
@@ -161,6 +168,10 @@ public:
   inline void on_exit_to_physical(delegate<void(net::Packet_ptr)> dlg)
   { on_exit_to_physical_ = dlg; };
 
+  /** Event triggered after a burst of received packets has been passed up */
+  inline void on_receive_done(delegate<void()> dlg)
+  { receive_done_event_ = dlg; };
+
 private:
 
   struct virtio_net_hdr
@@ -246,8 +257,12 @@ private:
 
   net::Packet_ptr transmit_queue_ {0};
 
+  bool csum_offload_ {false};
+
   delegate<void(net::Packet_ptr)> on_exit_to_physical_ {};
 
+  delegate<void()> receive_done_event_ = [] {};
+
 };
 
 #endif
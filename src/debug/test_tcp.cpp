@@ -40,7 +40,7 @@ void Service::start() {
   
   auto& server = inet->tcp().bind(80);
   
-  hw::PIT::instance().onTimeout(5s, [server]{
+  hw::PIT::instance().onTimeout(5s, [&server]{
       printf("Server is running: %s \n", server.to_string().c_str());
     });
 
@@ -0,0 +1,105 @@
+// This file is a part of the IncludeOS unikernel - www.includeos.org
+//
+// Copyright 2015 Oslo and Akershus University College of Applied Sciences
+// and Alfred Bratterud
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+//     http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <kernel/entropy.hpp>
+#include <kernel/cpuid.hpp>
+#include <kernel/os.hpp>
+#include <kernel/rdrand.hpp>
+#include <cstdlib>
+#include <cstring>
+
+uint32_t Entropy::key_[Entropy::key_words];
+uint32_t Entropy::pool_[Entropy::blocks * 16];
+uint64_t Entropy::counter_ = 0;
+unsigned Entropy::avail_ = 0;
+bool     Entropy::seeded_ = false;
+bool     Entropy::hardware_ = false;
+
+static inline uint32_t rotl(uint32_t x, int b) noexcept
+{ return (x << b) | (x >> (32 - b)); }
+
+static inline void quarter_round(uint32_t* x, int a, int b, int c, int d) noexcept
+{
+  x[a] += x[b]; x[d] ^= x[a]; x[d] = rotl(x[d], 16);
+  x[c] += x[d]; x[b] ^= x[c]; x[b] = rotl(x[b], 12);
+  x[a] += x[b]; x[d] ^= x[a]; x[d] = rotl(x[d], 8);
+  x[c] += x[d]; x[b] ^= x[c]; x[b] = rotl(x[b], 7);
+}
+
+/** One 64-byte ChaCha20 block, with a 64-bit block counter and no nonce */
+static void chacha20_block(const uint32_t* key, uint64_t counter, uint32_t* out) noexcept
+{
+  uint32_t in[16] {
+    0x61707865, 0x3320646e, 0x79622d32, 0x6b206574, // "expand 32-byte k"
+    key[0], key[1], key[2], key[3], key[4], key[5], key[6], key[7],
+    static_cast<uint32_t>(counter), static_cast<uint32_t>(counter >> 32), 0, 0
+  };
+  memcpy(out, in, sizeof(in));
+
+  for (int i = 0; i < 10; i++) {
+    quarter_round(out, 0, 4,  8, 12);
+    quarter_round(out, 1, 5,  9, 13);
+    quarter_round(out, 2, 6, 10, 14);
+    quarter_round(out, 3, 7, 11, 15);
+    quarter_round(out, 0, 5, 10, 15);
+    quarter_round(out, 1, 6, 11, 12);
+    quarter_round(out, 2, 7,  8, 13);
+    quarter_round(out, 3, 4,  9, 14);
+  }
+  for (int i = 0; i < 16; i++)
+    out[i] += in[i];
+}
+
+void Entropy::seed() noexcept
+{
+  const uint64_t tsc = OS::cycles_since_boot();
+  hardware_ = CPUID::hasRDRAND();
+  for (unsigned i = 0; i < key_words; i++) {
+    if (hardware_)
+      rdrand32(&key_[i]);
+    else
+      key_[i] = rand();
+    key_[i] ^= static_cast<uint32_t>(tsc >> (i & 1) * 32);
+  }
+  seeded_ = true;
+}
+
+void Entropy::refill() noexcept
+{
+  if (not seeded_)
+    seed();
+
+  for (unsigned b = 0; b < blocks; b++)
+    chacha20_block(key_, counter_++, &pool_[b * 16]);
+
+  // the next key is never handed out
+  avail_ = blocks * 16 - key_words;
+  memcpy(key_, &pool_[avail_], sizeof(key_));
+  memset(&pool_[avail_], 0, sizeof(key_));
+}
+
+void Entropy::fill(void* buf, size_t n) noexcept
+{
+  auto* dst = static_cast<uint8_t*>(buf);
+  while (n) {
+    const uint32_t r = random32();
+    const size_t len = n < 4 ? n : 4;
+    memcpy(dst, &r, len);
+    dst += len;
+    n -= len;
+  }
+}
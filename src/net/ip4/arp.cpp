@@ -21,6 +21,7 @@
 #include <vector>
 
 #include <os>
+#include <hw/pit.hpp>
 #include <net/inet4.hpp>
 #include <net/ip4/arp.hpp>
 #include <net/ip4/packet_arp.hpp>
@@ -35,7 +36,9 @@ namespace net {
   Arp::Arp(net::Inet<Ethernet,IP4>& inet) noexcept:
   inet_          {inet},
     mac_           (inet.link_addr()),
-    linklayer_out_ {ignore}
+    linklayer_out_ {ignore},
+    neighbors_     (table_size_),
+    pending_       (table_size_)
 {}
 
   void Arp::bottom(Packet_ptr pckt) {
@@ -43,8 +46,22 @@ namespace net {
 
     header* hdr = reinterpret_cast<header*>(pckt->buffer());
 
-    debug2("Have valid cache? %s\n", is_valid_cached(hdr->sipaddr) ? "YES" : "NO");
-    cache(hdr->sipaddr, hdr->shwaddr);
+    // RFC 826: Update the sender if we know it, only add it if we're the target.
+    // Probes (RFC 5227) have no sender IP, and are never cached.
+    if (hdr->sipaddr != IP4::INADDR_ANY) {
+      auto* n = find(hdr->sipaddr);
+
+      if (n) {
+        debug2("Updating neighbor %s: %s\n",
+               hdr->sipaddr.str().c_str(), hdr->shwaddr.str().c_str());
+        n->update(hdr->shwaddr);
+        flush_pending(*n);
+      } else if (hdr->dipaddr == inet_.ip_addr()) {
+        debug2("Caching IP %s for %s\n",
+               hdr->sipaddr.str().c_str(), hdr->shwaddr.str().c_str());
+        insert(hdr->sipaddr).update(hdr->shwaddr);
+      }
+    }
   
     switch(hdr->opcode) {
     
@@ -66,14 +83,6 @@ namespace net {
     case H_reply: {
       debug2("\t ARP REPLY: %s belongs to %s\n", 
              hdr->sipaddr.str().c_str(), hdr->shwaddr.str().c_str());
-
-      auto waiting = waiting_packets_.find(hdr->sipaddr);
-
-      if (waiting != waiting_packets_.end()) {
-        debug("Had a packet waiting for this IP. Sending\n");
-        transmit(waiting->second);
-        waiting_packets_.erase(waiting);
-      }
       break;
     }
     
@@ -83,35 +92,104 @@ namespace net {
     } //< switch(hdr->opcode)
   }
 
-  void Arp::cache(IP4::addr ip, Ethernet::addr mac) {
-    debug2("Caching IP %s for %s\n", ip.str().c_str(), mac.str().c_str());
-  
-    auto entry = cache_.find(ip);
+  Arp::neighbor* Arp::find(IP4::addr ip) {
+    const size_t mask = neighbors_.size() - 1;
 
-    if (entry != cache_.end()) {
-      debug2("Cached entry found: %s recorded @ %llu. Updating timestamp\n",
-             entry->second.mac_.str().c_str(), entry->second.timestamp_);
-    
-      // Update
-      entry->second.update();
-    
-    } else {
-      cache_[ip] = mac; // Insert
+    for (size_t i = home_slot(ip);; i = (i + 1) & mask) {
+      auto& n = neighbors_[i];
+
+      if (n.state_ == State::FREE)
+        return nullptr;
+
+      if (n.ip_ == ip and n.in_use())
+        return &n;
     }
   }
 
-  bool Arp::is_valid_cached(IP4::addr ip) {
-    auto entry = cache_.find(ip);
-  
-    if (entry != cache_.end()) {
-      debug("Cached entry, mac: %s time: %llu Expiry: %llu\n", 
-            entry->second.mac_.str().c_str(),
-            entry->second.timestamp_, entry->second.timestamp_ + cache_exp_t_);
-      debug("Time now: %llu\n", static_cast<uint64_t>(OS::uptime()));
+  Arp::neighbor* Arp::lookup(IP4::addr ip) {
+    auto* n = find(ip);
+
+    if (not n or not n->has_mac())
+      return n;
+
+    const uint32_t age = static_cast<uint32_t>(OS::uptime()) - n->timestamp_;
+
+    if (age >= cache_exp_t_) {
+      debug("<ARP> Entry for %s expired\n", ip.str().c_str());
+      erase(*n);
+      return nullptr;
+    }
+
+    if (n->state_ == State::REACHABLE and age >= reachable_t_)
+      n->state_ = State::STALE;
+
+    return n;
+  }
+
+  Arp::neighbor& Arp::insert(IP4::addr ip) {
+    // Keep the load (including tombstones) below 3/4
+    if ((used_ + deleted_ + 1) * 4 > neighbors_.size() * 3)
+      rehash(used_ * 2 >= neighbors_.size() ? neighbors_.size() * 2 : neighbors_.size());
+
+    const size_t mask = neighbors_.size() - 1;
+    size_t i = home_slot(ip);
+
+    while (neighbors_[i].in_use())
+      i = (i + 1) & mask;
+
+    auto& n = neighbors_[i];
+
+    if (n.state_ == State::DELETED)
+      deleted_--;
+    used_++;
+
+    n.ip_            = ip;
+    n.state_         = State::INCOMPLETE;
+    n.retries_       = 0;
+    n.generation_    = ++generation_;
+    n.pending_head_  = 0;
+    n.pending_count_ = 0;
+    n.timestamp_     = OS::uptime();
+    return n;
+  }
+
+  void Arp::erase(neighbor& n) {
+    auto& queue = pending_[index_of(n)];
+
+    for (auto& p : queue) p = nullptr;
+
+    n.state_         = State::DELETED;
+    n.pending_count_ = 0;
+    used_--;
+    deleted_++;
+  }
+
+  void Arp::rehash(size_t size) {
+    debug("<ARP> Rehashing neighbor table, %u -> %u slots\n",
+          neighbors_.size(), size);
+
+    Table old_neighbors(size);
+    std::vector<PacketQueue> old_pending(size);
+
+    old_neighbors.swap(neighbors_);
+    old_pending.swap(pending_);
+    used_    = 0;
+    deleted_ = 0;
+
+    const size_t mask = neighbors_.size() - 1;
+
+    for (size_t j = 0; j < old_neighbors.size(); ++j) {
+      if (not old_neighbors[j].in_use()) continue;
+
+      size_t i = home_slot(old_neighbors[j].ip_);
+
+      while (neighbors_[i].in_use())
+        i = (i + 1) & mask;
+
+      neighbors_[i] = old_neighbors[j];
+      pending_[i]   = std::move(old_pending[j]);
+      used_++;
     }
-  
-    return entry != cache_.end()
-      and (entry->second.timestamp_ + cache_exp_t_ > static_cast<uint64_t>(OS::uptime()));
   }
 
   extern "C" {
@@ -167,15 +245,20 @@ namespace net {
                sip.str().c_str(), inet_.ip_addr().str().c_str());
         return;
       }
-    
-      // If we don't have a cached IP, perform address resolution
-      if (!is_valid_cached(dip)) {
+
+      auto* n = lookup(dip);
+
+      // If we don't have a MAC, perform address resolution
+      if (not n or not n->has_mac()) {
         arp_resolver_(pckt);
         return;
       }
-    
-      // Get MAC from cache
-      dest_mac = cache_[dip].mac_;
+
+      // A stale MAC is still used, but we ask the neighbor to confirm it
+      if (n->state_ == State::STALE)
+        start_probe(*n);
+
+      dest_mac = n->mac_;
     }
   
     /** Attach next-hop mac and ethertype to ethernet header */
@@ -188,33 +271,124 @@ namespace net {
     linklayer_out_(pckt);
   }
 
-  void Arp::await_resolution(Packet_ptr pckt, IP4::addr) {
-    auto queue =  waiting_packets_.find(pckt->next_hop());
+  void Arp::announce() {
+    debug("<ARP> Announcing %s\n", inet_.ip_addr().str().c_str());
 
-    if (queue != waiting_packets_.end()) {
-      debug("<ARP Resolve> Packets already queueing for this IP\n");
-      queue->second->chain(pckt);    
-    } else {
-      debug("<ARP Resolve> This is the first packet going to that IP\n");
-      waiting_packets_.emplace(std::make_pair(pckt->next_hop(), pckt));
-    }            
+    // Gratuitous ARP request: sender and target are both our own IP
+    send_request(inet_.ip_addr(), Ethernet::addr::BROADCAST_FRAME);
   }
 
-  void Arp::arp_resolve(Packet_ptr pckt) {
-    debug("<ARP RESOLVE> %s\n", pckt->next_hop().str().c_str());
-  
-    await_resolution(pckt, pckt->next_hop());
-  
+  void Arp::send_request(IP4::addr ip, Ethernet::addr mac) {
     auto req = view_packet_as<PacketArp>(inet_.createPacket(sizeof(header)));
     req->init(mac_, inet_.ip_addr());
-  
-    req->set_dest_mac(Ethernet::addr::BROADCAST_FRAME);
-    req->set_dest_ip(pckt->next_hop());
+
+    req->set_dest_mac(mac);
+    req->set_dest_ip(ip);
     req->set_opcode(H_request);
-  
+
     linklayer_out_(req);
   }
 
+  void Arp::await_resolution(neighbor& n, Packet_ptr pckt) {
+    auto& queue = pending_[index_of(n)];
+
+    if (n.pending_count_ == max_pending_) {
+      // RFC 1122 2.3.2.2: Keep the latest packet
+      debug("<ARP Resolve> Queue full for %s, dropping the oldest packet\n",
+            n.ip_.str().c_str());
+      queue[n.pending_head_] = nullptr;
+      n.pending_head_ = (n.pending_head_ + 1) % max_pending_;
+      n.pending_count_--;
+    }
+
+    queue[(n.pending_head_ + n.pending_count_) % max_pending_] = pckt;
+    n.pending_count_++;
+  }
+
+  void Arp::flush_pending(neighbor& n) {
+    if (not n.pending_count_) return;
+
+    debug("<ARP> %u packets waiting for %s. Sending\n",
+          n.pending_count_, n.ip_.str().c_str());
+
+    // Transmitting can't touch the queue, since the neighbor now has a MAC,
+    // but take the packets out first anyway
+    PacketQueue queue;
+    auto& pending = pending_[index_of(n)];
+    const uint8_t count = n.pending_count_;
+
+    for (uint8_t i = 0; i < count; ++i)
+      queue[i] = std::move(pending[(n.pending_head_ + i) % max_pending_]);
+
+    n.pending_head_  = 0;
+    n.pending_count_ = 0;
+
+    for (uint8_t i = 0; i < count; ++i)
+      transmit(queue[i]);
+  }
+
+  void Arp::start_probe(neighbor& n) {
+    debug("<ARP> Probing stale neighbor %s\n", n.ip_.str().c_str());
+
+    n.state_      = State::PROBE;
+    n.retries_    = 0;
+    n.generation_ = ++generation_;
+    send_request(n.ip_, n.mac_);
+    schedule_retry(n);
+  }
+
+  void Arp::schedule_retry(const neighbor& n) {
+    const auto ip = n.ip_;
+    const auto generation = n.generation_;
+    hw::PIT::on_timeout(retry_t_ * (1 << n.retries_),
+      [this, ip, generation] { retry(ip, generation); });
+  }
+
+  void Arp::retry(IP4::addr ip, uint16_t generation) {
+    auto* n = find(ip);
+
+    // Resolved, removed, or from an earlier run of retries
+    if (not n or n->generation_ != generation
+        or (n->state_ != State::INCOMPLETE and n->state_ != State::PROBE))
+      return;
+
+    if (n->retries_ >= max_retries_) {
+      debug("<ARP> %s didn't answer after %u attempts. Giving up\n",
+            ip.str().c_str(), n->retries_ + 1);
+      erase(*n);
+      return;
+    }
+
+    n->retries_++;
+
+    if (n->state_ == State::INCOMPLETE)
+      send_request(ip, Ethernet::addr::BROADCAST_FRAME);
+    else
+      send_request(ip, n->mac_);
+
+    schedule_retry(*n);
+  }
+
+  void Arp::arp_resolve(Packet_ptr pckt) {
+    const auto ip = pckt->next_hop();
+    debug("<ARP RESOLVE> %s\n", ip.str().c_str());
+
+    auto* n = find(ip);
+
+    if (n) {
+      debug("<ARP Resolve> Packets already queueing for this IP\n");
+      await_resolution(*n, pckt);
+      return;
+    }
+
+    debug("<ARP Resolve> This is the first packet going to that IP\n");
+    auto& entry = insert(ip);
+    await_resolution(entry, pckt);
+
+    send_request(ip, Ethernet::addr::BROADCAST_FRAME);
+    schedule_retry(entry);
+  }
+
   void Arp::hh_map(Packet_ptr pckt) {
     (void) pckt;
     debug("ARP-resolution using the HH-hack");
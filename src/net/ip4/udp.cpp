@@ -19,6 +19,7 @@
 #include <os>
 #include <net/ip4/udp.hpp>
 #include <net/util.hpp>
+#include <cstddef>
 #include <memory>
 
 #define likely(x)       __builtin_expect(!!(x), 1)
@@ -27,7 +28,7 @@
 namespace net {
 
   UDP::UDP(Stack& inet)
-    : stack_(inet)
+    : stack_(inet), ports_(65536)
   {
     network_layer_out_ = [] (net::Packet_ptr) {};
     inet.on_transmit_queue_available(
@@ -42,11 +43,26 @@ namespace net {
     debug("\t Source port: %i, Dest. Port: %i Length: %i\n",
           udp->src_port(), udp->dst_port(), udp->length());
 
-    auto it = ports_.find(udp->dst_port());
-    if (it != ports_.end())
+    if (unlikely(udp->length() < sizeof(udp_header)
+                 or udp->length() > udp->size() - sizeof(IP4::full_header)))
       {
+        debug("<UDP> Bad length %i. Drop!\n", udp->length());
+        length_errors_++;
+        return;
+      }
+
+    auto* socket = ports_[udp->dst_port()].get();
+    if (socket)
+      {
+        if (socket->checksum_enabled() and unlikely(not udp->checksum_ok()))
+          {
+            debug("<UDP> Bad checksum 0x%x. Drop!\n", ntohs(udp->header().checksum));
+            checksum_errors_++;
+            return;
+          }
+
         debug("<UDP> Someone's listening to this port. Forwarding...\n");
-        it->second.internal_read(udp);
+        socket->internal_read(udp);
         return;
       }
 
@@ -56,31 +72,25 @@ namespace net {
   UDPSocket& UDP::bind(UDP::port_t port)
   {
     debug("<UDP> Binding to port %i\n", port);
-    /// ... !!!
-    auto it = ports_.find(port);
-    if (likely(it == ports_.end())) {
+
+    auto& socket = ports_[port];
+    if (likely(!socket)) {
       // create new socket
-      auto res = ports_.emplace(
-                                std::piecewise_construct,
-                                std::forward_as_tuple(port),
-                                std::forward_as_tuple(*this, port));
-      it = res.first;
+      socket.reset(new UDPSocket(*this, port));
+      bound_ports_.bind(port);
     }
-    return it->second;
+    return *socket;
   }
 
   UDPSocket& UDP::bind() {
 
-    if (ports_.size() >= 0xfc00)
-      panic("UPD Socket: All ports taken!");
-
     debug("UDP finding free ephemeral port\n");
-    while (ports_.find(++current_port_) != ports_.end())
-      // prevent automatic ports under 1024
-      if (current_port_  == 0) current_port_ = 1024;
+    auto port = bound_ports_.bind_ephemeral();
+    if (unlikely(port == 0))
+      panic("UPD Socket: All ports taken!");
 
-    debug("UDP binding to %i port\n", current_port_);
-    return bind(current_port_);
+    debug("UDP binding to %i port\n", port);
+    return bind(port);
   }
 
   void UDP::transmit(UDP::Packet_ptr udp) {
@@ -96,6 +106,27 @@ namespace net {
     network_layer_out_(pckt);
   }
 
+  void UDP::deliver_batches()
+  {
+    // sockets may batch again from their handlers
+    auto pending = std::move(batches_pending_);
+    batches_pending_.clear();
+
+    for (auto* socket : pending)
+      {
+        socket->batch_queued = false;
+        socket->deliver_batch();
+      }
+  }
+
+  void UDP::checksum(PacketUDP& udp)
+  {
+    if (stack_.checksum_offload())
+      udp.offload_checksum();
+    else
+      udp.gen_checksum();
+  }
+
   void UDP::flush()
   {
     size_t packets = stack_.transmit_queue_available();
@@ -110,9 +141,8 @@ namespace net {
       {
         WriteBuffer& buffer = sendq.front();
 
-        // create and transmit packet from writebuffer
-        buffer.write();
-        num--;
+        // create and transmit as many packets as there's room for
+        num -= buffer.write(num);
 
         if (buffer.done())
           {
@@ -131,71 +161,143 @@ namespace net {
 
   size_t UDP::WriteBuffer::packets_needed() const
   {
-    int r = remaining();
-    // whole packets
-    size_t P = r / udp.max_datagram_size();
-    // one packet for remainder
-    if (r % udp.max_datagram_size()) P++;
-    return P;
+    if (datagram) return done() ? 0 : 1;
+    return udp.datagrams_needed(remaining());
   }
+
   UDP::WriteBuffer::WriteBuffer(
-                                const uint8_t* data, size_t length, sendto_handler cb,
-                                UDP& stack, addr_t LA, port_t LP, addr_t DA, port_t DP)
+                                fragments frags, size_t length, sendto_handler cb,
+                                UDP& stack, addr_t LA, port_t LP, addr_t DA, port_t DP,
+                                bool csum)
     : len(length), offset(0), callback(cb), udp(stack),
-      l_addr(LA), l_port(LP), d_port(DP), d_addr(DA)
+      l_addr(LA), l_port(LP), d_port(DP), d_addr(DA), checksum(csum)
   {
-    // create a copy of the data,
+    // gather a copy of the data,
     auto* copy = new uint8_t[len];
-    memcpy(copy, data, length);
+    size_t pos = 0;
+    for (auto& frag : frags) {
+      memcpy(copy + pos, frag.data, frag.length);
+      pos += frag.length;
+    }
     // make it shared
     this->buf =
       std::shared_ptr<uint8_t> (copy, std::default_delete<uint8_t[]>());
   }
 
-  void UDP::WriteBuffer::write()
-  {
-
-    // the bytes remaining to be written
-    UDP::Packet_ptr chain_head{};
+  UDP::WriteBuffer::WriteBuffer(Packet_ptr dgram, sendto_handler cb, UDP& stack)
+    : datagram(dgram), len(dgram->data_length()), offset(0), callback(cb), udp(stack),
+      l_addr(dgram->src()), l_port(dgram->src_port()),
+      d_port(dgram->dst_port()), d_addr(dgram->dst()), checksum(false)
+  {}
 
-    debug("<UDP> %i bytes to write, need %i packets \n",
-           remaining(), remaining() / udp.max_datagram_size() + (remaining() % udp.max_datagram_size() ? 1 : 0));
-
-    do {
-      size_t total = remaining();
-      total = (total > udp.max_datagram_size()) ? udp.max_datagram_size() : total;
+  size_t UDP::WriteBuffer::write(size_t num)
+  {
+    if (datagram)
+      {
+        // headers and checksum are already in place
+        udp.transmit(datagram);
+        datagram = nullptr;
+        offset = len;
+        return 1;
+      }
 
-      // create some packet p (and convert it to PacketUDP)
-      auto p = udp.stack().createPacket(0);
-      // fill buffer (at payload position)
-      memcpy(p->buffer() + PacketUDP::HEADERS_SIZE,
-             buf.get() + this->offset, total);
+    debug("<UDP> %i bytes to write, need %i packets, room for %i\n",
+          remaining(), packets_needed(), num);
 
-      // initialize packet with several infos
-      auto p2 = std::static_pointer_cast<PacketUDP>(p);
+    size_t sent = 0;
+    while (remaining() && sent < num)
+      {
+        size_t total = remaining();
+        total = (total > udp.max_datagram_size()) ? udp.max_datagram_size() : total;
+
+        // create some packet p (and convert it to PacketUDP)
+        auto p = udp.stack().createPacket(0);
+        // fill buffer (at payload position)
+        memcpy(p->buffer() + PacketUDP::HEADERS_SIZE,
+               buf.get() + this->offset, total);
+
+        // initialize packet with several infos
+        auto p2 = std::static_pointer_cast<PacketUDP>(p);
+
+        p2->init();
+        p2->header().sport = htons(l_port);
+        p2->header().dport = htons(d_port);
+        p2->set_src(l_addr);
+        p2->set_dst(d_addr);
+        p2->set_length(total);
+
+        if (checksum)
+          udp.checksum(*p2);
+
+        // every datagram is a packet of its own, since lower layers
+        // only fill in the headers of the first packet in a chain
+        udp.transmit(p2);
+        sent++;
+
+        // next position in buffer
+        this->offset += total;
+      }
 
-      p2->init();
-      p2->header().sport = htons(l_port);
-      p2->header().dport = htons(d_port);
-      p2->set_src(l_addr);
-      p2->set_dst(d_addr);
-      p2->set_length(total);
+    return sent;
+  }
 
-      // Attach packet to chain
-      if (!chain_head)
-        chain_head = p2;
-      else
-        chain_head->chain(p2);
+  // one's complement sum (RFC 1071) of 16-bit words in network order,
+  // left unfolded. fine for anything up to 128 KiB
+  static uint32_t sum_words(const void* data, size_t len, uint32_t sum) noexcept
+  {
+    auto* words = reinterpret_cast<const uint16_t*>(data);
+    for (size_t i = 0; i < len / 2; i++)
+      sum += words[i];
+    // odd-length case, zero-padded
+    if (len & 1)
+      sum += reinterpret_cast<const uint8_t*>(data)[len - 1];
+    return sum;
+  }
 
-      // next position in buffer
-      this->offset += total;
+  static uint16_t fold(uint32_t sum) noexcept
+  {
+    while (sum >> 16)
+      sum = (sum & 0xffff) + (sum >> 16);
+    return sum;
+  }
 
-    } while ( remaining() );
+  uint32_t PacketUDP::pseudo_sum() const
+  {
+    const uint32_t saddr = src().whole;
+    const uint32_t daddr = dst().whole;
+    // source, destination, zero + protocol and UDP length
+    return (saddr & 0xffff) + (saddr >> 16)
+      + (daddr & 0xffff) + (daddr >> 16)
+      + htons(IP4::IP4_UDP) + header().length;
+  }
 
-    // ship the packet
-    udp.transmit(chain_head);
+  uint16_t PacketUDP::gen_checksum()
+  {
+    header().checksum = 0;
+    // no offloading this one
+    set_checksum_offload(0, 0);
+
+    uint16_t sum = ~fold(sum_words(&header(), length(), pseudo_sum()));
+    // RFC 768: an all zero checksum is transmitted as all ones
+    header().checksum = sum ? sum : 0xffff;
+    return header().checksum;
+  }
 
+  void PacketUDP::offload_checksum()
+  {
+    // the NIC sums from the UDP header and on,
+    // including the pseudo header sum we leave in the checksum field
+    header().checksum = fold(pseudo_sum());
+    set_checksum_offload(sizeof(IP4::full_header),
+                         offsetof(UDP::udp_header, checksum));
+  }
 
+  bool PacketUDP::checksum_ok() const
+  {
+    if (header().checksum == 0)
+      return true;
+    // summing over the checksum as well gives all ones
+    return fold(sum_words(&header(), length(), pseudo_sum())) == 0xffff;
   }
 
 } //< namespace net
@@ -16,6 +16,7 @@
 // limitations under the License.
 
 #include <net/ip4/udp_socket.hpp>
+#include <algorithm>
 #include <memory>
 
 #define likely(x)       __builtin_expect(!!(x), 1)
@@ -46,10 +47,41 @@ namespace net
 
   void UDPSocket::internal_read(UDP::Packet_ptr udp)
   {
+    if (max_batch)
+      {
+        if (not batch_queued)
+          {
+            this->udp.batches_pending_.push_back(this);
+            batch_queued = true;
+          }
+
+        batch.emplace_back(std::move(udp));
+        if (batch.size() >= max_batch)
+          deliver_batch();
+        return;
+      }
+
     on_read_handler(
                     udp->src(), udp->src_port(), udp->data(), udp->data_length());
   }
 
+  void UDPSocket::on_read_batch(batch_handler callback, size_t max)
+  {
+    assert(max);
+    on_batch_handler = callback;
+    max_batch = max;
+    batch.reserve(max);
+  }
+
+  void UDPSocket::deliver_batch()
+  {
+    if (batch.empty()) return;
+
+    on_batch_handler(datagrams(batch.data(), batch.size()));
+    // anything not moved out by the handler goes back to the NIC
+    batch.clear();
+  }
+
   void UDPSocket::sendto(
                          addr_t destIP,
                          port_t port,
@@ -57,15 +89,16 @@ namespace net
                          size_t len,
                          sendto_handler cb)
   {
-    if (likely(len))
-      {
-        udp.sendq.emplace_back(
-                               (const uint8_t*) buffer, len, cb, this->udp,
-                               local_addr(), this->l_port, destIP, port);
-
-        // UDP packets are meant to be sent immediately, so try flushing
-        udp.flush();
-      }
+    fragment frag {buffer, len};
+    send(local_addr(), destIP, port, fragments(&frag, 1), cb);
+  }
+  void UDPSocket::sendto(
+                         addr_t destIP,
+                         port_t port,
+                         fragments frags,
+                         sendto_handler cb)
+  {
+    send(local_addr(), destIP, port, frags, cb);
   }
   void UDPSocket::bcast(
                         addr_t srcIP,
@@ -74,15 +107,93 @@ namespace net
                         size_t len,
                         sendto_handler cb)
   {
-    if (likely(len))
+    fragment frag {buffer, len};
+    send(srcIP, IP4::INADDR_BCAST, port, fragments(&frag, 1), cb);
+  }
+
+  void UDPSocket::send(
+                       addr_t srcIP,
+                       addr_t destIP,
+                       port_t port,
+                       fragments frags,
+                       sendto_handler cb)
+  {
+    size_t len = 0;
+    for (auto& frag : frags)
+      len += frag.length;
+
+    if (unlikely(len == 0)) return;
+
+    // nothing queued ahead of us, and room for the whole message:
+    // gather straight into NIC buffers and send right away
+    if (udp.sendq.empty()
+        and udp.stack().transmit_queue_available() >= udp.datagrams_needed(len))
       {
-        udp.sendq.emplace_back(
-                               (const uint8_t*) buffer, len, cb, this->udp,
-                               srcIP, this->l_port, IP4::INADDR_BCAST, port);
+        auto frag = frags.begin();
+        size_t frag_off = 0;
+
+        while (len)
+          {
+            size_t total = std::min<size_t>(len, udp.max_datagram_size());
+            auto p = std::static_pointer_cast<PacketUDP>(udp.stack().createPacket(0));
+
+            char* dst = p->data();
+            for (size_t left = total; left; )
+              {
+                size_t n = std::min<size_t>(left, frag->length - frag_off);
+                memcpy(dst, (const char*) frag->data + frag_off, n);
+                dst += n; left -= n; frag_off += n;
+                // move on to the next fragment
+                if (frag_off == frag->length) { ++frag; frag_off = 0; }
+              }
+
+            packet_init(p, srcIP, destIP, port, total);
+            if (checksum) udp.checksum(*p);
+            udp.transmit(p);
+            len -= total;
+          }
+        cb();
+        return;
+      }
+
+    // otherwise keep a copy until there's room
+    udp.sendq.emplace_back(
+                           frags, len, cb, this->udp,
+                           srcIP, this->l_port, destIP, port, checksum);
+
+    // UDP packets are meant to be sent immediately, so try flushing
+    udp.flush();
+  }
+
+  UDP::Packet_ptr UDPSocket::create_packet()
+  {
+    auto p = std::static_pointer_cast<PacketUDP>(udp.stack().createPacket(0));
+    // the whole payload is writable until sendto() sets the real length
+    packet_init(p, local_addr(), IP4::INADDR_ANY, 0, udp.max_datagram_size());
+    return p;
+  }
 
-        // UDP packets are meant to be sent immediately, so try flushing
-        udp.flush();
+  void UDPSocket::sendto(
+                         addr_t destIP,
+                         port_t port,
+                         UDP::Packet_ptr p,
+                         size_t len,
+                         sendto_handler cb)
+  {
+    assert(len <= udp.max_datagram_size());
+
+    packet_init(p, local_addr(), destIP, port, len);
+    if (checksum) udp.checksum(*p);
+
+    if (udp.sendq.empty() and udp.stack().transmit_queue_available())
+      {
+        udp.transmit(p);
+        cb();
+        return;
       }
+
+    udp.sendq.emplace_back(p, cb, this->udp);
+    udp.flush();
   }
 
 }
@@ -23,16 +23,21 @@
 using namespace std;
 using namespace net;
 
+const uint8_t TCP::Half_open::no_wscale;
+constexpr uint16_t TCP::syn_cookie_mss[];
 
 TCP::TCP(IPStack& inet) :
   inet_(inet),
-  listeners_(),
+  listeners_(65536),
   connections_(),
   writeq(),
   used_ports(),
   MAX_SEG_LIFETIME(30s)
 {
   inet.on_transmit_queue_available(transmit_avail_delg::from<TCP,&TCP::process_writeq>(this));
+
+  Entropy::fill(cookie_key_, sizeof(cookie_key_));
+  Entropy::fill(iss_key_, sizeof(iss_key_));
 }
 
 /*
@@ -47,14 +52,23 @@ TCP::TCP(IPStack& inet) :
   Simple.
 */
 TCP::Connection& TCP::bind(Port port) {
+  auto listener = try_bind(port);
+  if(!listener)
+    throw TCPException{error_string(listener.error())};
+  return **listener;
+}
+
+TCP::Expected<TCP::Connection*> TCP::try_bind(Port port) {
+  auto& connection = listeners_[port];
   // Already a listening socket.
-  if(listeners_.find(port) != listeners_.end()) {
-    throw TCPException{"Port is already taken."};
-  }
-  auto& connection = (listeners_.emplace(port, Connection{*this, port})).first->second;
+  if(connection)
+    return Error::PORT_TAKEN;
+  connection.reset(new Connection{*this, port});
+  listener_count_++;
+  used_ports.bind(port);
   debug("<TCP::bind> Bound to port %i \n", port);
-  connection.open(false);
-  return connection;
+  connection->open(false);
+  return connection.get();
 }
 
 /*
@@ -79,39 +93,48 @@ void TCP::connect(Socket remote, Connection::ConnectCallback callback) {
   connection->onConnect(callback).open(true);
 }
 
-TCP::Seq TCP::generate_iss() {
-  // Do something to get a iss.
-  return rand();
-}
-
 /*
-  TODO: Check if there is any ports free.
+  Active open a new connection to the given remote, with data for the SYN.
 */
-TCP::Port TCP::next_free_port() {
+TCP::Connection_ptr TCP::connect(Socket remote, buffer_t data, size_t n, Connection::WriteCallback callback) {
+  auto port = next_free_port();
+  auto connection = add_connection(port, remote);
+  // picked up by the SYN, see Connection::send_syn
+  connection->writeq.push_back({Connection::WriteBuffer{data, n, true}, callback});
+  connection->open(true);
+  return connection;
+}
 
-  if(++current_ephemeral_ == 0) {
-    current_ephemeral_ = 1025;
-    // TODO: Can be taken
-  }
-  // Avoid giving a port that is bound to a service.
-  while(listeners_.find(current_ephemeral_) != listeners_.end())
-    current_ephemeral_++;
+uint64_t TCP::Clock::mult_ = 0;
 
-  return current_ephemeral_;
+void TCP::Clock::calibrate() {
+  auto khz = KHz(hw::PIT::CPUFrequency()).count();
+  mult_ = (uint64_t)((1ull << 36) / khz);
+  debug("<TCP::Clock> Calibrated: %f KHz\n", khz);
 }
 
 /*
-  Expensive look up if port is in use.
+  ISN = M + F(localip, localport, remoteip, remoteport, secretkey) [RFC 6528]
+
+  M ticks every 4 us, here 250 at a time as the clock has ms resolution.
 */
-bool TCP::port_in_use(const TCP::Port port) const {
-  if(listeners_.find(port) != listeners_.end())
-    return true;
+TCP::Seq TCP::generate_iss(const Connection::Tuple& tuple) const {
+  const uint32_t words[3] {
+    inet_.ip_addr().whole,
+    tuple.second.address().whole,
+    (uint32_t) tuple.first << 16 | tuple.second.port()
+  };
+  return Clock::now() * 250 + HalfSipHash::hash(iss_key_, words, 3);
+}
 
-  for(auto conn : connections_) {
-    if(conn.first.first == port)
-      return true;
-  }
-  return false;
+/*
+  Bind a random free ephemeral port.
+*/
+TCP::Port TCP::next_free_port() {
+  auto port = used_ports.bind_ephemeral();
+  if(port == 0)
+    throw TCPException{error_string(Error::NO_FREE_PORT)};
+  return port;
 }
 
 
@@ -181,27 +204,40 @@ void TCP::bottom(net::Packet_ptr packet_ptr) {
   Connection::Tuple tuple { packet->dst_port(), packet->source() };
 
   // Try to find the receiver
-  auto conn_it = connections_.find(tuple);
+  auto* found = connections_.find(tuple);
   // Connection found
-  if(conn_it != connections_.end()) {
-    debug("<TCP::bottom> Connection found: %s \n", conn_it->second->to_string().c_str());
-    conn_it->second->segment_arrived(packet);
+  if(found) {
+    // Keep it alive, the connection might close (and leave the table) on this segment
+    auto conn = *found;
+    debug("<TCP::bottom> Connection found: %s \n", conn->to_string().c_str());
+    conn->segment_arrived(packet);
+  }
+  // What's left of a closed connection
+  else if(auto* tw = time_wait_.find(tuple)) {
+    time_wait_segment(tuple, *tw, packet);
   }
   // No connection found
   else {
     // Is there a listener?
-    auto listen_conn_it = listeners_.find(packet->dst_port());
+    auto* listen_conn = listeners_[packet->dst_port()].get();
     debug("<TCP::bottom> No connection found - looking for listener..\n");
-    // Listener found => Create listening Connection
-    if(listen_conn_it != listeners_.end()) {
-      auto& listen_conn = listen_conn_it->second;
-      debug("<TCP::bottom> Listener found: %s ...\n", listen_conn.to_string().c_str());
-      auto connection = (connections_.emplace(tuple, std::make_shared<Connection>(listen_conn)).first->second);
-      // Set remote
-      connection->set_remote(packet->source());
-      debug("<TCP::bottom> ... Creating connection: %s \n", connection->to_string().c_str());
-
-      connection->segment_arrived(packet);
+    // Listener found => handshake, without a Connection until it completes
+    if(listen_conn) {
+      debug("<TCP::bottom> Listener found: %s ...\n", listen_conn->to_string().c_str());
+      if(packet->isset(RST)) {
+        if(half_open_.erase(tuple))
+          listen_conn->cold().syn_queued--;
+        drop(packet);
+      }
+      else if(packet->isset(SYN) and !packet->isset(ACK)) {
+        syn_received(*listen_conn, tuple, packet);
+      }
+      else if(packet->isset(ACK) and !packet->isset(SYN)) {
+        handshake_completed(*listen_conn, tuple, packet);
+      }
+      else {
+        drop(packet);
+      }
     }
     // No listener found
     else {
@@ -212,13 +248,52 @@ void TCP::bottom(net::Packet_ptr packet_ptr) {
 
 void TCP::process_writeq(size_t packets) {
   debug2("<TCP::process_writeq> size=%u p=%u\n", writeq.size(), packets);
-  // foreach connection who wants to write
+  // write callbacks may ask for more while we're offering
+  if(tx_busy_)
+    return;
+  tx_busy_ = true;
+
+  // deficit round-robin over the connections who want to write
   while(packets and !writeq.empty()) {
     auto conn = writeq.front();
-    writeq.pop_back();
-    conn->offer(packets);
-    conn->set_queued(false);
+    writeq.pop_front();
+
+    // a new turn, unless the last one ran out of packets
+    if(!tx_resume_) {
+      conn->tx_deficit_ += (uint32_t)tx_quantum_ * conn->tx_weight_;
+      tx_stats_.rounds++;
+    }
+    tx_resume_ = false;
+
+    if(conn->can_send()) {
+      size_t turn = std::min<size_t>(packets, conn->tx_deficit_);
+      const size_t offered = turn;
+      conn->offer(turn);
+      const uint32_t used = offered - turn;
+
+      packets -= used;
+      conn->tx_deficit_ -= used;
+      conn->tx_packets_ += used;
+      tx_stats_.packets += used;
+    }
+
+    // done for now, and an idle connection doesn't save up turns
+    if(!conn->can_send()) {
+      conn->tx_deficit_ = 0;
+      conn->set_queued(false);
+    }
+    // finish the turn when there's room again
+    else if(conn->tx_deficit_ and !packets) {
+      writeq.push_front(conn);
+      tx_resume_ = true;
+      tx_stats_.deferred++;
+    }
+    else {
+      writeq.push_back(conn);
+    }
   }
+
+  tx_busy_ = false;
 }
 
 size_t TCP::send(Connection_ptr conn, const char* buffer, size_t n) {
@@ -227,18 +302,404 @@ size_t TCP::send(Connection_ptr conn, const char* buffer, size_t n) {
 
   debug2("<TCP::send> Send request for %u bytes\n", n);
 
-  if(packets > 0) {
+  // only write directly when nobody is waiting for their turn,
+  // otherwise the write is queued and served by process_writeq
+  if(packets > 0 and writeq.empty()) {
+    const auto before = packets;
     written += conn->send(buffer, n, packets);
+    conn->tx_packets_ += before - packets;
+    tx_stats_.packets += before - packets;
   }
-  // if connection still can send (means there wasn't enough packets)
-  // only requeue if not already queued
+
+  return written;
+}
+
+void TCP::request_offer(Connection_ptr conn) {
+  debug2("<TCP::request_offer> %u unsent bytes, %u waiting\n", conn->writeq.unsent, writeq.size());
+
   if(conn->can_send() and !conn->is_queued()) {
-    debug2("<TCP::send> Conn queued.\n");
     writeq.push_back(conn);
     conn->set_queued(true);
+    tx_stats_.max_queued = std::max(tx_stats_.max_queued, writeq.size());
   }
 
-  return written;
+  kick();
+}
+
+void TCP::pace(Connection_ptr conn) {
+  paced_.push_back(conn);
+  if(!pacing_timer_active_) {
+    pacing_timer_active_ = true;
+    hw::PIT::instance().onTimeout(1ms, [this] { pacing_timeout(); });
+  }
+}
+
+void TCP::pacing_timeout() {
+  pacing_timer_active_ = false;
+  std::vector<std::weak_ptr<Connection>> due;
+  due.swap(paced_);
+  // the ones still held go back on the list
+  for(auto& weak : due) {
+    if(auto conn = weak.lock()) {
+      conn->cold_->pacing.waiting = false;
+      conn->writeq_push();
+    }
+  }
+}
+
+double TCP::tx_fairness() const {
+  double sum = 0, sum_sq = 0;
+  size_t n = 0;
+  connections_.for_each([&](const Connection::Tuple&, const Connection_ptr& conn) {
+      if(!conn->tx_packets_)
+        return;
+      const double x = (double)conn->tx_packets_ / conn->tx_weight_;
+      sum += x;
+      sum_sq += x * x;
+      n++;
+    });
+  return n ? (sum * sum) / (n * sum_sq) : 1.0;
+}
+
+void TCP::reset_tx_stats() {
+  tx_stats_ = Tx_stats{};
+  tx_stats_.max_queued = writeq.size();
+  connections_.for_each([](const Connection::Tuple&, const Connection_ptr& conn) {
+      conn->tx_packets_ = 0;
+    });
+}
+
+void TCP::set_keepalive(std::chrono::seconds idle, std::chrono::seconds interval, uint8_t probes) {
+  // connections count probes in 6 bits, and idle seconds in 16
+  Expects(idle.count() > 0 and interval.count() > 0);
+  Expects(probes > 0 and probes < 64);
+  Expects(idle.count() + probes * interval.count() <= UINT16_MAX);
+  keepalive_idle_ = idle.count();
+  keepalive_interval_ = interval.count();
+  keepalive_probes_ = probes;
+}
+
+void TCP::syn_received(Connection& listener, const Connection::Tuple& tuple, TCP::Packet_ptr syn) {
+  // a retransmitted SYN
+  if(auto* h = half_open_.find(tuple)) {
+    if(syn->seq() == h->irs)
+      send_synack(tuple, *h, Clock::now());
+    else
+      drop(syn);
+    return;
+  }
+
+  // no room once established, the peer will try again
+  if(listener.accept_queue_full()) {
+    debug("<TCP::syn_received> Accept queue full (%u), dropping SYN\n", listener.accept_queued());
+    drop(syn);
+    return;
+  }
+
+  Half_open h;
+  Fastopen_cookie tfo;
+  h.irs = syn->seq();
+  h.wnd = syn->win();
+  // an ECN-setup SYN [RFC 3168]
+  h.ecn = ecn_ and syn->isset(ECE) and syn->isset(CWR);
+  if(syn->has_options())
+    parse_syn_options(*syn, h, nullptr, &tfo);
+
+  // Fast Open: a valid cookie lets the data in the SYN in right away,
+  // unless the half-open connections say we're flooded [RFC 7413]
+  Fastopen_cookie cookie;
+  const Fastopen_cookie* give = nullptr;
+  if(tfo.present and listener.fastopen()) {
+    fastopen_cookie(tuple.second.address(), cookie);
+    if(tfo == cookie and syn->has_data()
+      and listener.syn_queued() < listener.syn_backlog())
+    {
+      fastopen_accept(listener, tuple, h, syn);
+      return;
+    }
+    // a request, or a cookie we no longer take
+    give = &cookie;
+  }
+
+  // keep state for it
+  if(listener.syn_queued() < listener.syn_backlog()) {
+    h.iss = generate_iss(tuple);
+    h.sent = Clock::now();
+    half_open_.emplace(tuple, h);
+    listener.cold().syn_queued++;
+    send_synack(tuple, h, h.sent, give);
+
+    if(!syn_timer_active_) {
+      syn_timer_active_ = true;
+      hw::PIT::instance().onTimeout(1s, [this] { syn_timeout(); });
+    }
+    return;
+  }
+
+  // backlog full, answer with a cookie [RFC 4987 3.6]
+  uint8_t index = 0;
+  while(index < 7 and syn_cookie_mss[index + 1] <= h.mss)
+    index++;
+  h.iss = syn_cookie(tuple, h.irs, Clock::now() >> 16, index);
+
+  // only a timestamp can carry these through the cookie, don't offer what
+  // the ACK can't give back
+  if(!h.ts) {
+    h.wscale = Half_open::no_wscale;
+    h.sack = false;
+    h.ecn = false;
+  }
+
+  // without state, WS, SACK and ECN only survive in our timestamp. Its low
+  // bits are taken, so keep it in the past for the peer's PAWS check.
+  uint32_t ts_val = ((Clock::now() - 64) & ~0x3f) | (h.ecn << 5) | (h.sack << 4)
+    | (h.wscale == Half_open::no_wscale ? 0xf : h.wscale);
+  debug("<TCP::syn_received> SYN backlog full (%u), sending cookie\n", listener.syn_queued());
+  send_synack(tuple, h, ts_val, give);
+}
+
+void TCP::handshake_completed(Connection& listener, const Connection::Tuple& tuple, TCP::Packet_ptr ack) {
+  // leave it half-open, the SYN-ACK or the peer's data is retransmitted
+  if(listener.accept_queue_full()) {
+    drop(ack);
+    return;
+  }
+
+  Half_open h;
+  if(auto* found = half_open_.find(tuple)) {
+    if(ack->ack() != found->iss + 1) {
+      send_reset(ack);
+      return;
+    }
+    h = *found;
+    half_open_.erase(tuple);
+    listener.cold().syn_queued--;
+  }
+  else if(!syn_cookie_valid(tuple, ack, h)) {
+    send_reset(ack);
+    return;
+  }
+
+  auto connection = std::allocate_shared<Connection>(Connection_allocator(), *this, tuple.first, tuple.second);
+  connection->inherit(listener);
+  if(!connection->signal_accept()) {
+    send_reset(ack);
+    return;
+  }
+  connection->accept_handshake(h);
+  connections_.emplace(tuple, connection);
+  debug("<TCP::handshake_completed> Creating connection: %s \n", connection->to_string().c_str());
+
+  connection->segment_arrived(ack);
+}
+
+void TCP::send_synack(const Connection::Tuple& tuple, const Half_open& h, uint32_t ts_val,
+                      const Fastopen_cookie* cookie) {
+  auto packet = std::static_pointer_cast<TCP::Packet>(inet_.createPacket(TCP::Packet::HEADERS_SIZE));
+  packet->init();
+  packet->set_source({inet_.ip_addr(), tuple.first});
+  packet->set_destination(tuple.second);
+  packet->set_seq(h.iss).set_ack(h.irs + 1).set_flags(SYN | ACK);
+  packet->set_win(default_window_size);
+  if(h.ecn)
+    packet->set_flag(ECE);
+
+  if(h.ts)
+    packet->add_option<Option::opt_timestamp>(ts_val, h.ts_recent);
+  packet->add_option<Option::opt_mss>(MSS());
+  // scale our window only if the remote scales its own [RFC 7323 p. 9]
+  if(h.wscale != Half_open::no_wscale)
+    packet->add_option<Option::opt_ws>(default_window_shift);
+  if(h.sack)
+    packet->add_option<Option::opt_sack_perm>();
+  if(cookie)
+    packet->add_option<Option::opt_fastopen>(cookie->data, cookie->length);
+
+  transmit(packet);
+}
+
+void TCP::send_reset(TCP::Packet_ptr in) {
+  auto packet = std::static_pointer_cast<TCP::Packet>(inet_.createPacket(TCP::Packet::HEADERS_SIZE));
+  packet->init();
+  packet->set_source({inet_.ip_addr(), in->dst_port()});
+  packet->set_destination(in->source());
+  packet->set_seq(in->ack()).set_flag(RST);
+  transmit(packet);
+  drop(in);
+}
+
+void TCP::parse_syn_options(TCP::Packet& syn, Half_open& h, uint32_t* ts_ecr, Fastopen_cookie* cookie) {
+  // from a peer we know nothing about, trust no length
+  auto* opt = syn.options();
+  auto* const end = (uint8_t*)syn.data();
+  while(opt < end) {
+    auto* option = (TCP::Option*)opt;
+    if(option->kind == Option::END)
+      return;
+    if(option->kind == Option::NOP) {
+      opt++;
+      continue;
+    }
+    if(end - opt < 2 or option->length < 2 or option->length > end - opt)
+      return;
+
+    switch(option->kind) {
+    case Option::MSS:
+      if(option->length == 4)
+        h.mss = ntohs(((Option::opt_mss*)option)->mss);
+      break;
+    case Option::WS:
+      if(option->length == 3)
+        h.wscale = std::min(option->data[0], (uint8_t)14);
+      break;
+    case Option::SACK_PERM:
+      h.sack = true;
+      break;
+    case Option::TS:
+      if(option->length == 10) {
+        h.ts = true;
+        h.ts_recent = ntohl(*(uint32_t*)(option->data));
+        if(ts_ecr)
+          *ts_ecr = ntohl(*(uint32_t*)(option->data + 4));
+      }
+      break;
+    case Option::TFO:
+      // too long for us is as good as invalid. The length is within
+      // the header, checked before the switch, so the copy is too.
+      if(cookie and option->length - 2 <= Fastopen_cookie::max_length) {
+        cookie->present = true;
+        cookie->length = option->length - 2;
+        memcpy(cookie->data, option->data, cookie->length);
+      }
+      break;
+    default:
+      break;
+    }
+    opt += option->length;
+  }
+}
+
+void TCP::syn_timeout() {
+  const auto now = Clock::now();
+  std::vector<Connection::Tuple> expired, resend;
+
+  half_open_.for_each([&](const Connection::Tuple& tuple, const Half_open& h) {
+      // RTO starts at 1s and backs off [RFC 6298]
+      if(now - h.sent >= (1000u << h.retries))
+        (h.retries < 4 ? resend : expired).push_back(tuple);
+    });
+
+  for(auto& tuple : resend) {
+    auto* h = half_open_.find(tuple);
+    h->retries++;
+    h->sent = now;
+    send_synack(tuple, *h, now);
+  }
+
+  for(auto& tuple : expired) {
+    half_open_.erase(tuple);
+    if(auto& listener = listeners_[tuple.first])
+      listener->cold().syn_queued--;
+  }
+
+  syn_timer_active_ = half_open_.size() > 0;
+  if(syn_timer_active_)
+    hw::PIT::instance().onTimeout(1s, [this] { syn_timeout(); });
+}
+
+TCP::Seq TCP::syn_cookie(const Connection::Tuple& tuple, Seq irs, uint32_t time, uint8_t mss_index) const {
+  const uint32_t words[4] {
+    tuple.second.address().whole,
+    static_cast<uint32_t>(tuple.first) << 16 | tuple.second.port(),
+    irs,
+    time << 3 | mss_index
+  };
+  const auto hash = HalfSipHash::hash(cookie_key_, words, 4);
+  return (time & 0x1f) << 27 | (mss_index & 0x7) << 24 | (hash & 0xffffff);
+}
+
+bool TCP::syn_cookie_valid(const Connection::Tuple& tuple, TCP::Packet_ptr ack, Half_open& h) const {
+  const Seq cookie = ack->ack() - 1;
+  const Seq irs = ack->seq() - 1;
+  const uint8_t index = (cookie >> 24) & 0x7;
+
+  // sent in this period or the one before, ~1-2 minutes ago at most
+  const uint32_t now = Clock::now() >> 16;
+  uint32_t time = now;
+  if((now & 0x1f) != (cookie >> 27)) {
+    time = now - 1;
+    if((time & 0x1f) != (cookie >> 27))
+      return false;
+  }
+  if(syn_cookie(tuple, irs, time, index) != cookie)
+    return false;
+
+  h.irs = irs;
+  h.iss = cookie;
+  h.mss = syn_cookie_mss[index];
+  h.cookie = true;
+
+  // WS, SACK and ECN from the timestamp we sent, echoed back
+  Half_open opts;
+  uint32_t ecr = 0;
+  if(ack->has_options())
+    parse_syn_options(*ack, opts, &ecr);
+  if(opts.ts) {
+    h.ts = true;
+    h.ts_recent = opts.ts_recent;
+    h.sack = ecr & 0x10;
+    h.ecn = ecr & 0x20;
+    h.wscale = ((ecr & 0xf) == 0xf) ? Half_open::no_wscale : (ecr & 0xf);
+  }
+  h.wnd = (uint32_t)ack->win() << (h.wscale == Half_open::no_wscale ? 0 : h.wscale);
+  return true;
+}
+
+void TCP::fastopen_cookie(Address addr, Fastopen_cookie& cookie) const {
+  // apart from SYN cookies by the word count, and the tag
+  uint32_t words[3] { addr.whole, 0x54464f00, 0 };
+  for(uint8_t i = 0; i < 2; i++) {
+    words[2] = i;
+    const auto hash = HalfSipHash::hash(cookie_key_, words, 3);
+    memcpy(cookie.data + i*4, &hash, 4);
+  }
+  cookie.length = 8;
+}
+
+void TCP::fastopen_accept(Connection& listener, const Connection::Tuple& tuple, Half_open& h, TCP::Packet_ptr syn) {
+  h.iss = generate_iss(tuple);
+  auto connection = std::allocate_shared<Connection>(Connection_allocator(), *this, tuple.first, tuple.second);
+  connection->inherit(listener);
+  if(!connection->signal_accept()) {
+    drop(syn);
+    return;
+  }
+  connection->accept_handshake(h);
+  connections_.emplace(tuple, connection);
+  debug("<TCP::fastopen_accept> Creating connection: %s \n", connection->to_string().c_str());
+
+  connection->fastopen_accepted(syn);
+}
+
+const TCP::Fastopen_cookie* TCP::fastopen_lookup(Address addr) const {
+  auto it = fastopen_cache_.find(addr.whole);
+  return it != fastopen_cache_.end() ? &it->second : nullptr;
+}
+
+void TCP::fastopen_remember(Address addr, const uint8_t* data, uint8_t length) {
+  // only what goes in our SYN without padding
+  if(length == 0 or length % 4 or length > Fastopen_cookie::max_length)
+    return;
+  auto it = fastopen_cache_.find(addr.whole);
+  if(it == fastopen_cache_.end()) {
+    if(fastopen_cache_.size() >= fastopen_cache_max)
+      fastopen_cache_.erase(fastopen_cache_.begin());
+    it = fastopen_cache_.emplace(addr.whole, Fastopen_cookie{}).first;
+  }
+  auto& cookie = it->second;
+  memcpy(cookie.data, data, length);
+  cookie.length = length;
+  cookie.present = true;
 }
 
 /*
@@ -253,34 +714,175 @@ string TCP::to_string() const {
   // Write all connections in a cute list.
   stringstream ss;
   ss << "LISTENING SOCKETS:\n";
-  for(auto listen_it : listeners_) {
-    ss << listen_it.second.to_string() << "\n";
+  for(auto& listener : listeners_) {
+    if(listener)
+      ss << listener->to_string() << "\n";
   }
   ss << "\nCONNECTIONS:\n" <<  "Proto\tRecv\tSend\tIn\tOut\tLocal\t\t\tRemote\t\t\tState\n";
-  for(auto con_it : connections_) {
-    auto& c = *(con_it.second);
+  connections_.for_each([&ss](const Connection::Tuple&, const Connection_ptr& conn) {
+    auto& c = *conn;
     ss << "tcp4\t"
        << " " << "\t" << " " << "\t"
        << " " << "\t" << " " << "\t"
        << c.local().to_string() << "\t\t" << c.remote().to_string() << "\t\t"
        << c.state().to_string() << "\n";
-  }
+  });
   return ss.str();
 }
 
 
 TCP::Connection_ptr TCP::add_connection(Port local_port, TCP::Socket remote) {
-  return        (connections_.emplace(
-                                      Connection::Tuple{ local_port, remote },
-                                      std::make_shared<Connection>(*this, local_port, remote))
-                 ).first->second;
+  return        *(connections_.emplace(
+                                       Connection::Tuple{ local_port, remote },
+                                       std::allocate_shared<Connection>(Connection_allocator(), *this, local_port, remote))
+                  ).first;
 }
 
 void TCP::close_connection(TCP::Connection& conn) {
   debug("<TCP::close_connection> Closing connection: %s \n", conn.to_string().c_str());
+  release_port(conn.local_port());
   connections_.erase(conn.tuple());
 }
 
+void TCP::release_port(Port port) {
+  // Release the ephemeral port of an outgoing connection
+  if(!listeners_[port])
+    used_ports.unbind(port);
+}
+
+void TCP::enter_time_wait(Connection& conn) {
+  const auto tuple = conn.tuple();
+  debug("<TCP::enter_time_wait> %s \n", conn.to_string().c_str());
+
+  Time_wait tw;
+  tw.snd_nxt = conn.cb.SND.NXT;
+  tw.rcv_nxt = conn.cb.RCV.NXT;
+  tw.ts = conn.ts.ok;
+  tw.ts_recent = conn.ts.recent;
+
+  // the port stays taken until the record expires
+  connections_.erase(tuple);
+  auto* record = time_wait_.emplace(tuple, tw).first;
+  time_wait_arm(tuple, *record);
+}
+
+void TCP::time_wait_arm(const Connection::Tuple& tuple, Time_wait& tw) {
+  const uint32_t ticks = round_up(std::max<uint32_t>(2 * MSL().count(), 1), 1000);
+  const bool placed = tw.expires != 0;
+  tw.expires = time_wait_tick_ + ticks;
+  // already on the wheel, it'll be moved when its old slot comes up
+  if(!placed)
+    time_wait_wheel_[tw.expires % time_wait_slots].push_back(tuple);
+
+  if(!time_wait_timer_active_) {
+    time_wait_timer_active_ = true;
+    hw::PIT::instance().onTimeout(1s, [this] { time_wait_timeout(); });
+  }
+}
+
+void TCP::time_wait_segment(const Connection::Tuple& tuple, Time_wait& tw, TCP::Packet_ptr in) {
+  if(in->isset(RST)) {
+    time_wait_.erase(tuple);
+    release_port(tuple.first);
+    drop(in);
+    return;
+  }
+
+  Half_open opts;
+  if(in->has_options())
+    parse_syn_options(*in, opts);
+
+  if(in->isset(SYN) and !in->isset(ACK)) {
+    // A new incarnation may reuse the tuple, if its segments can't be
+    // mistaken for old ones: a later timestamp [RFC 6191], or without
+    // timestamps, a higher sequence number [RFC 1122 4.2.2.13].
+    const bool newer = (tw.ts and opts.ts) ? seq_lt(tw.ts_recent, opts.ts_recent)
+                                          : seq_lt(tw.rcv_nxt, in->seq());
+    auto& listener = listeners_[tuple.first];
+    if(newer and listener) {
+      debug("<TCP::time_wait_segment> Recycling TIME-WAIT for new SYN\n");
+      time_wait_.erase(tuple);
+      syn_received(*listener, tuple, in);
+      return;
+    }
+  }
+
+  // Only a retransmitted FIN is expected, ACK it and restart the timer.
+  // Anything else but a bare ACK gets an ACK too [RFC 793 p. 69].
+  if(in->isset(FIN))
+    time_wait_arm(tuple, tw);
+  else if(!in->isset(SYN) and !in->has_data()) {
+    drop(in);
+    return;
+  }
+
+  auto packet = std::static_pointer_cast<TCP::Packet>(inet_.createPacket(TCP::Packet::HEADERS_SIZE));
+  packet->init();
+  packet->set_source({inet_.ip_addr(), tuple.first});
+  packet->set_destination(tuple.second);
+  packet->set_seq(tw.snd_nxt).set_ack(tw.rcv_nxt).set_flag(ACK);
+  if(tw.ts)
+    packet->add_option<Option::opt_timestamp>(Clock::now(), opts.ts ? opts.ts_recent : tw.ts_recent);
+  transmit(packet);
+  drop(in);
+}
+
+void TCP::time_wait_timeout() {
+  const auto now = ++time_wait_tick_;
+  auto& slot = time_wait_wheel_[now % time_wait_slots];
+  std::vector<Connection::Tuple> later;
+
+  for(auto& tuple : slot) {
+    auto* tw = time_wait_.find(tuple);
+    // recycled or reset
+    if(!tw)
+      continue;
+    // restarted, or more than a turn of the wheel away
+    if(tw->expires > now) {
+      auto& next = time_wait_wheel_[tw->expires % time_wait_slots];
+      (&next == &slot ? later : next).push_back(tuple);
+      continue;
+    }
+    time_wait_.erase(tuple);
+    release_port(tuple.first);
+  }
+  slot.swap(later);
+
+  time_wait_timer_active_ = time_wait_.size() > 0;
+  if(time_wait_timer_active_)
+    hw::PIT::instance().onTimeout(1s, [this] { time_wait_timeout(); });
+}
+
+void TCP::idle_arm(Connection_ptr conn, uint32_t seconds) {
+  idle_wheel_[(idle_tick_ + seconds) % idle_slots].push_back(conn);
+  idle_armed_++;
+
+  if(!idle_timer_active_) {
+    idle_timer_active_ = true;
+    hw::PIT::instance().onTimeout(1s, [this] { idle_timeout(); });
+  }
+}
+
+void TCP::idle_timeout() {
+  const auto now = ++idle_tick_;
+  std::vector<std::weak_ptr<Connection>> due;
+  due.swap(idle_wheel_[now % idle_slots]);
+  idle_armed_ -= due.size();
+
+  for(auto& ref : due) {
+    auto conn = ref.lock();
+    // closed since
+    if(!conn)
+      continue;
+    if(const auto next = conn->idle_check(now))
+      idle_arm(conn, next);
+  }
+
+  idle_timer_active_ = idle_armed_ > 0;
+  if(idle_timer_active_)
+    hw::PIT::instance().onTimeout(1s, [this] { idle_timeout(); });
+}
+
 void TCP::drop(TCP::Packet_ptr) {
   //debug("<TCP::drop> Packet was dropped - no recipient: %s \n", packet->destination().to_string().c_str());
 }
@@ -0,0 +1,568 @@
+// This file is a part of the IncludeOS unikernel - www.includeos.org
+//
+// Copyright 2015-2016 Oslo and Akershus University College of Applied Sciences
+// and Alfred Bratterud
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#define DEBUG
+#define DEBUG2
+
+#include <net/tcp.hpp>
+#include <algorithm>
+
+using namespace net;
+using Connection = TCP::Connection;
+using Congestion_control = TCP::Congestion_control;
+using Clock = TCP::Clock;
+
+/////////////////////////////////////////////////////////////////////
+/*
+  What the algorithms get to see of the connection.
+*/
+uint32_t Congestion_control::cwnd(const Connection& conn)
+{ return conn.cb.cwnd; }
+
+void Congestion_control::set_cwnd(Connection& conn, uint32_t cwnd)
+{ conn.cb.cwnd = cwnd; }
+
+uint32_t Congestion_control::ssthresh(const Connection& conn)
+{ return conn.cb.ssthresh; }
+
+void Congestion_control::set_ssthresh(Connection& conn, uint32_t ssthresh)
+{ conn.cb.ssthresh = ssthresh; }
+
+uint16_t Congestion_control::smss(const Connection& conn)
+{ return conn.SMSS(); }
+
+uint32_t Congestion_control::flight_size(const Connection& conn)
+{ return conn.flight_size(); }
+
+TCP::Seq Congestion_control::snd_una(const Connection& conn)
+{ return conn.cb.SND.UNA; }
+
+TCP::Seq Congestion_control::snd_nxt(const Connection& conn)
+{ return conn.cb.SND.NXT; }
+
+bool Congestion_control::ecn_cut(const Connection& conn)
+{ return conn.ecn_cut and TCP::seq_lt(conn.cb.SND.UNA, conn.cold_->ecn_end); }
+
+void Congestion_control::set_ecn_cut(Connection& conn) {
+  conn.ecn_cut = true;
+  conn.cold().ecn_end = conn.cb.SND.NXT;
+}
+
+uint32_t Congestion_control::half_flight(const Connection& conn) {
+  auto fs = conn.flight_size();
+  const auto two_seg = 2*(uint32_t)conn.SMSS();
+
+  // don't count what limited transmit sent [RFC 3042 p. 4]
+  if(conn.limited_tx_)
+    fs = (fs >= two_seg) ? fs - two_seg : 0;
+
+  return std::max(fs / 2, two_seg);
+}
+
+/*
+  IW [RFC 5681 p. 5], and ssthresh as high as the peer's window.
+*/
+void Congestion_control::init(Connection& conn) {
+  set_cwnd(conn, 3*smss(conn));
+  set_ssthresh(conn, conn.cb.SND.WND);
+}
+
+/*
+  Deflate the window, but not into a burst [RFC 6582 p. 6]
+*/
+void Congestion_control::on_recovery_done(Connection& conn) {
+  set_cwnd(conn, std::min(ssthresh(conn),
+    std::max(flight_size(conn), (uint32_t)smss(conn)) + smss(conn)));
+}
+
+/*
+  ECN-Echo: halve, like for a loss but without a retransmission,
+  and not again until what was sent before is ACKed [RFC 3168 6.1.2]
+*/
+bool Congestion_control::on_ecn(Connection& conn, uint32_t, bool ece) {
+  if(!ece or ecn_cut(conn))
+    return false;
+  set_ssthresh(conn, half_flight(conn));
+  set_cwnd(conn, ssthresh(conn));
+  set_ecn_cut(conn);
+  return true;
+}
+/////////////////////////////////////////////////////////////////////
+
+namespace {
+
+/////////////////////////////////////////////////////////////////////
+/*
+  NewReno [RFC 5681] [RFC 6582]
+
+  Slow start, then one segment per RTT. Halve on loss.
+*/
+class NewReno : public Congestion_control {
+public:
+  const char* name() const override
+  { return "NewReno"; }
+
+  void on_ack(Connection& conn, uint32_t bytes_acked) override {
+    const uint32_t mss = smss(conn);
+    auto cw = cwnd(conn);
+    // slow start
+    if(cw < ssthresh(conn))
+      cw += std::min(bytes_acked, mss);
+    // congestion avoidance
+    else
+      cw += std::max(mss*mss/cw, (uint32_t)1);
+    set_cwnd(conn, cw);
+  }
+
+  void on_loss(Connection& conn) override {
+    set_ssthresh(conn, half_flight(conn));
+    set_cwnd(conn, ssthresh(conn));
+  }
+
+  void on_rto(Connection& conn, bool first) override {
+    if(first)
+      set_ssthresh(conn, half_flight(conn));
+    set_cwnd(conn, smss(conn));
+  }
+};
+/////////////////////////////////////////////////////////////////////
+
+/////////////////////////////////////////////////////////////////////
+/*
+  CUBIC [RFC 8312]
+
+  After a loss, cwnd follows W(t) = C*(t-K)^3 + W_max: quickly back up
+  to where the loss happened, carefully around it, and then probing
+  faster and faster. Never slower than Reno would be.
+  Fixed point, in bytes and milliseconds. C = 0.4, beta = 0.7.
+*/
+class Cubic : public Congestion_control {
+public:
+  const char* name() const override
+  { return "CUBIC"; }
+
+  void on_ack(Connection& conn, uint32_t bytes_acked) override {
+    const uint32_t mss = smss(conn);
+    auto cw = cwnd(conn);
+
+    // slow start
+    if(cw < ssthresh(conn)) {
+      set_cwnd(conn, cw + std::min(bytes_acked, mss));
+      return;
+    }
+
+    const auto now = Clock::now();
+    if(!in_epoch_)
+      start_epoch(cw, mss, now);
+
+    acked_ += bytes_acked;
+
+    // t + RTT [RFC 8312 4.1]
+    const uint32_t t = now - epoch_ + min_rtt_;
+    uint64_t target = w_cubic(t, mss);
+
+    // Reno-friendly region, 3(1-beta)/(1+beta) segments per window ACKed [RFC 8312 4.2]
+    const uint64_t est = w_est_ + acked_ * mss * 53 / (100 * (uint64_t)cw);
+    target = std::max(target, est);
+
+    // at most 1.5 times per RTT [RFC 8312 4.1]
+    target = std::min(target, (uint64_t)cw * 3 / 2);
+
+    // concave and convex region [RFC 8312 4.3] [RFC 8312 4.4]
+    if(target > cw)
+      frac_ += bytes_acked * (target - cw);
+    // plateau, barely move
+    else
+      frac_ += bytes_acked * mss / 100;
+
+    cw += frac_ / cw;
+    frac_ %= cw;
+    set_cwnd(conn, cw);
+  }
+
+  void on_loss(Connection& conn) override {
+    const auto cw = cwnd(conn);
+    reduce(conn, cw);
+    set_cwnd(conn, ssthresh(conn));
+  }
+
+  void on_rto(Connection& conn, bool first) override {
+    if(first)
+      reduce(conn, flight_size(conn));
+    in_epoch_ = false;
+    set_cwnd(conn, smss(conn));
+  }
+
+  void on_rtt(Connection&, uint32_t rtt) override {
+    if(!min_rtt_ or rtt < min_rtt_)
+      min_rtt_ = rtt;
+  }
+
+private:
+  uint32_t w_max_ = 0;       // cwnd just before the last reduction
+  uint32_t w_last_max_ = 0;  // the one before that, for fast convergence
+  uint32_t w_est_ = 0;       // Reno-friendly cwnd when the epoch started
+  uint32_t origin_ = 0;      // plateau of the cubic function
+  uint32_t k_ = 0;           // ms from epoch until back at the plateau
+  uint32_t min_rtt_ = 0;
+  Clock::tick_t epoch_ = 0;
+  bool in_epoch_ = false;
+  uint64_t acked_ = 0;       // bytes ACKed this epoch
+  uint64_t frac_ = 0;        // cwnd increase not applied yet, times cwnd
+
+  /*
+    Fast convergence [RFC 8312 4.6], and multiplicative decrease [RFC 8312 4.5]
+  */
+  void reduce(Connection& conn, uint32_t cw) {
+    in_epoch_ = false;
+    if(cw < w_last_max_) {
+      w_last_max_ = cw;
+      w_max_ = (uint64_t)cw * 17 / 20; // (1 + beta) / 2
+    }
+    else {
+      w_max_ = w_last_max_ = cw;
+    }
+    set_ssthresh(conn, std::max((uint32_t)((uint64_t)cw * 7 / 10), 2*(uint32_t)smss(conn)));
+  }
+
+  void start_epoch(uint32_t cw, uint32_t mss, Clock::tick_t now) {
+    in_epoch_ = true;
+    epoch_ = now;
+    acked_ = 0;
+    frac_ = 0;
+    w_est_ = cw;
+    if(cw < w_max_) {
+      // K = cbrt((W_max - cwnd) / C), in segments and seconds
+      k_ = icbrt((uint64_t)(w_max_ - cw) * 2500000 / mss * 1000);
+      origin_ = w_max_;
+    }
+    else {
+      k_ = 0;
+      origin_ = cw;
+    }
+  }
+
+  /*
+    W(t) = C*(t-K)^3 + W_max, t in ms [RFC 8312 4.1]
+  */
+  uint64_t w_cubic(uint32_t t, uint32_t mss) const {
+    int64_t d = (int64_t)t - k_;
+    // far enough out either way
+    d = std::max(std::min(d, (int64_t)60000), (int64_t)-60000);
+    const int64_t off = d*d*d / 1000000 * mss * 4 / 10000;
+    return std::max(origin_ + off, (int64_t)0);
+  }
+
+  /*
+    Integer cube root [Hacker's Delight 11-2]
+  */
+  static uint32_t icbrt(uint64_t x) {
+    uint64_t y = 0;
+    for(int s = 63; s >= 0; s -= 3) {
+      y <<= 1;
+      const uint64_t b = 3*y*(y + 1) + 1;
+      if((x >> s) >= b) {
+        x -= b << s;
+        y++;
+      }
+    }
+    return y;
+  }
+};
+/////////////////////////////////////////////////////////////////////
+
+/////////////////////////////////////////////////////////////////////
+/*
+  BBR [Cardwell et al., "BBR: Congestion-Based Congestion Control", 2016]
+
+  Models the path from the bottleneck bandwidth (max delivery rate over
+  the last rounds) and the propagation delay (min RTT over the last 10s),
+  and keeps about one BDP in flight instead of filling queues until loss.
+  Gains are in 1/256ths. The delivery rate is sampled once per round trip.
+*/
+constexpr uint32_t bbr_unit = 256;
+constexpr uint32_t bbr_high_gain = 739;  // 2/ln(2)
+constexpr uint32_t bbr_drain_gain = 88;  // 1/high_gain
+constexpr uint32_t bbr_cwnd_gain = 512;
+constexpr uint32_t bbr_cycle_gain[] = { 320, 192, 256, 256, 256, 256, 256, 256 };
+
+class Bbr : public Congestion_control {
+public:
+  const char* name() const override
+  { return "BBR"; }
+
+  void on_ack(Connection& conn, uint32_t bytes_acked) override {
+    const auto now = Clock::now();
+    if(!started_) {
+      started_ = true;
+      round_end_ = snd_nxt(conn);
+      round_start_ = now;
+    }
+
+    delivered_ += bytes_acked;
+
+    // a round trip is over, sample the delivery rate
+    if(TCP::seq_leq(round_end_, snd_una(conn))) {
+      const uint32_t elapsed = std::max((uint32_t)(now - round_start_), (uint32_t)1);
+      bw_[round_++ % bw_rounds] = (uint64_t)delivered_ * 1000 / elapsed;
+      delivered_ = 0;
+      round_start_ = now;
+      round_end_ = snd_nxt(conn);
+      check_full_pipe();
+    }
+
+    update_mode(conn, now);
+    update_cwnd(conn, bytes_acked);
+  }
+
+  /*
+    Loss says little about the path; conserve packets during recovery,
+    and go back to where we were when it's over.
+  */
+  void on_loss(Connection& conn) override {
+    prior_cwnd_ = cwnd(conn);
+    set_cwnd(conn, std::max(flight_size(conn), min_cwnd(conn)));
+  }
+
+  void on_recovery_done(Connection& conn) override
+  { set_cwnd(conn, std::max(cwnd(conn), prior_cwnd_)); }
+
+  void on_rto(Connection& conn, bool first) override {
+    if(first)
+      prior_cwnd_ = std::max(prior_cwnd_, cwnd(conn));
+    set_cwnd(conn, smss(conn));
+  }
+
+  void on_rtt(Connection&, uint32_t rtt) override {
+    const auto now = Clock::now();
+    rtt = std::max(rtt, (uint32_t)1);
+    const bool expired = min_rtt_ and (now - min_rtt_stamp_ > min_rtt_win);
+    if(expired)
+      probe_rtt_due_ = true;
+    if(!min_rtt_ or rtt <= min_rtt_ or expired) {
+      min_rtt_ = rtt;
+      min_rtt_stamp_ = now;
+    }
+  }
+
+  uint32_t pacing_rate() const override
+  { return (uint64_t)max_bw() * pacing_gain() / bbr_unit; }
+
+private:
+  enum Mode : uint8_t { STARTUP, DRAIN, PROBE_BW, PROBE_RTT };
+
+  static constexpr uint32_t bw_rounds = 10;       // max bw filter window, in rounds
+  static constexpr uint32_t min_rtt_win = 10000;  // min RTT filter window, ms
+  static constexpr uint32_t probe_rtt_time = 200; // ms
+
+  uint32_t bw_[bw_rounds] {};  // delivery rate per round, bytes/s
+  uint32_t round_ = 0;
+  TCP::Seq round_end_ = 0;
+  Clock::tick_t round_start_ = 0;
+  uint32_t delivered_ = 0;     // bytes ACKed this round
+
+  uint32_t min_rtt_ = 0;
+  Clock::tick_t min_rtt_stamp_ = 0;
+
+  uint32_t full_bw_ = 0;
+  uint32_t prior_cwnd_ = 0;
+  Clock::tick_t cycle_stamp_ = 0;
+  Clock::tick_t probe_rtt_done_ = 0;
+
+  Mode mode_ = STARTUP;
+  uint8_t full_bw_cnt_ = 0;
+  uint8_t cycle_ = 0;
+  bool filled_pipe_ = false;
+  bool probe_rtt_due_ = false;
+  bool restore_cwnd_ = false;
+  bool started_ = false;
+
+  uint32_t max_bw() const
+  { return *std::max_element(std::begin(bw_), std::end(bw_)); }
+
+  uint32_t pacing_gain() const {
+    switch(mode_) {
+    case STARTUP:   return bbr_high_gain;
+    case DRAIN:     return bbr_drain_gain;
+    case PROBE_BW:  return bbr_cycle_gain[cycle_];
+    default:        return bbr_unit;
+    }
+  }
+
+  static uint32_t min_cwnd(const Connection& conn)
+  { return 4*(uint32_t)smss(conn); }
+
+  uint32_t bdp() const
+  { return (uint64_t)max_bw() * min_rtt_ / 1000; }
+
+  uint32_t target_cwnd(const Connection& conn, uint32_t gain) const {
+    if(!min_rtt_ or !max_bw())
+      return 3*(uint32_t)smss(conn);
+    return std::max((uint32_t)((uint64_t)bdp() * gain / bbr_unit), min_cwnd(conn));
+  }
+
+  /*
+    Startup is over when the bandwidth hasn't grown by 25% in three rounds.
+  */
+  void check_full_pipe() {
+    if(filled_pipe_)
+      return;
+    const auto bw = max_bw();
+    if((uint64_t)bw * 4 >= (uint64_t)full_bw_ * 5) {
+      full_bw_ = bw;
+      full_bw_cnt_ = 0;
+      return;
+    }
+    if(++full_bw_cnt_ >= 3)
+      filled_pipe_ = true;
+  }
+
+  void update_mode(const Connection& conn, Clock::tick_t now) {
+    if(mode_ == STARTUP and filled_pipe_)
+      mode_ = DRAIN;
+
+    // the queue built in startup is gone
+    if(mode_ == DRAIN and flight_size(conn) <= bdp()) {
+      mode_ = PROBE_BW;
+      cycle_ = 2;
+      cycle_stamp_ = now;
+    }
+
+    if(mode_ == PROBE_BW and min_rtt_ and now - cycle_stamp_ > min_rtt_) {
+      cycle_ = (cycle_ + 1) % 8;
+      cycle_stamp_ = now;
+    }
+
+    // haven't seen the min RTT in a while, drain the queue to see it again
+    if(mode_ != PROBE_RTT and (probe_rtt_due_ or (min_rtt_ and now - min_rtt_stamp_ > min_rtt_win))) {
+      mode_ = PROBE_RTT;
+      probe_rtt_due_ = false;
+      prior_cwnd_ = std::max(prior_cwnd_, cwnd(conn));
+      probe_rtt_done_ = now + probe_rtt_time;
+    }
+
+    if(mode_ == PROBE_RTT and (int32_t)(now - probe_rtt_done_) >= 0) {
+      min_rtt_stamp_ = now;
+      mode_ = filled_pipe_ ? PROBE_BW : STARTUP;
+      cycle_stamp_ = now;
+      restore_cwnd_ = true;
+    }
+  }
+
+  void update_cwnd(Connection& conn, uint32_t bytes_acked) {
+    auto cw = cwnd(conn);
+
+    if(mode_ == PROBE_RTT) {
+      set_cwnd(conn, min_cwnd(conn));
+      return;
+    }
+
+    if(restore_cwnd_) {
+      restore_cwnd_ = false;
+      cw = std::max(cw, prior_cwnd_);
+    }
+
+    const auto target = target_cwnd(conn, filled_pipe_ ? bbr_cwnd_gain : bbr_high_gain);
+    if(filled_pipe_)
+      cw = std::min(cw + bytes_acked, target);
+    else if(cw < target or !max_bw())
+      cw += bytes_acked;
+
+    set_cwnd(conn, std::max(cw, min_cwnd(conn)));
+  }
+};
+
+constexpr uint32_t Bbr::bw_rounds;
+constexpr uint32_t Bbr::min_rtt_win;
+constexpr uint32_t Bbr::probe_rtt_time;
+/////////////////////////////////////////////////////////////////////
+
+/////////////////////////////////////////////////////////////////////
+/*
+  DCTCP [RFC 8257]
+
+  NewReno, except that ECN-Echo takes cwnd down in proportion to how
+  much gets marked: by alpha/2, where alpha is a moving average of the
+  fraction of bytes marked each window. For datacenters, where switches
+  mark early and both ends run it; the receiver echoes every mark.
+*/
+class Dctcp : public NewReno {
+public:
+  const char* name() const override
+  { return "DCTCP"; }
+
+  bool on_ecn(Connection& conn, uint32_t bytes_acked, bool ece) override {
+    acked_ += bytes_acked;
+    if(ece)
+      marked_ += bytes_acked;
+
+    // a window's worth seen, alpha = (1 - g) * alpha + g * F
+    if(!in_window_ or !TCP::seq_lt(snd_una(conn), window_end_)) {
+      if(in_window_ and acked_) {
+        const uint32_t f = (uint64_t)marked_ * alpha_unit / acked_;
+        alpha_ = alpha_ - (alpha_ >> g_shift) + (f >> g_shift);
+      }
+      acked_ = 0;
+      marked_ = 0;
+      window_end_ = snd_nxt(conn);
+      in_window_ = true;
+    }
+
+    if(!ece or ecn_cut(conn))
+      return false;
+    const auto cw = cwnd(conn);
+    const uint32_t cut = (uint64_t)cw * alpha_ / (2 * alpha_unit);
+    set_ssthresh(conn, std::max(cw - cut, 2 * (uint32_t)smss(conn)));
+    set_cwnd(conn, ssthresh(conn));
+    set_ecn_cut(conn);
+    return true;
+  }
+
+  bool ecn_per_segment() const override
+  { return true; }
+
+private:
+  static constexpr uint32_t alpha_unit = 1024;
+  static constexpr int g_shift = 4; // g = 1/16
+
+  // as if everything was marked, until there's something to go by
+  uint32_t alpha_ = alpha_unit;
+  uint32_t acked_ = 0;
+  uint32_t marked_ = 0;
+  TCP::Seq window_end_ = 0;
+  bool in_window_ = false;
+};
+/////////////////////////////////////////////////////////////////////
+
+} // < namespace
+
+std::unique_ptr<Congestion_control> Congestion_control::create(TCP::Congestion algorithm) {
+  switch(algorithm) {
+  case TCP::CUBIC:
+    return std::make_unique<Cubic>();
+  case TCP::BBR:
+    return std::make_unique<Bbr>();
+  case TCP::DCTCP:
+    return std::make_unique<Dctcp>();
+  default:
+    return std::make_unique<NewReno>();
+  }
+}
+
+Congestion_control& Congestion_control::newreno() {
+  static NewReno shared;
+  return shared;
+}
@@ -26,6 +26,11 @@ using Connection = TCP::Connection;
 using namespace std;
 
 const TCP::Connection::RTTM::duration_t TCP::Connection::RTTM::CLOCK_G;
+const TCP::Connection::RTTM::duration_t TCP::Connection::RTTM::RTO_MIN;
+const TCP::Connection::RTTM::duration_t TCP::Connection::RTTM::RTO_MAX;
+const uint32_t TCP::Connection::delack_ms;
+const size_t TCP::Connection::ReassemblyQueue::max_segments;
+const uint32_t TCP::Connection::Scoreboard::dup_thresh;
 
 /*
   This is most likely used in a ACTIVE open
@@ -37,14 +42,59 @@ Connection::Connection(TCP& host, Port local_port, Socket remote) :
   state_(&Connection::Closed::instance()),
   prev_state_(state_),
   cb(),
-  read_request(),
   writeq(),
+  reassq(),
+  idle_(),
   queued_(false),
-  time_wait_started(0)
+  callbacks_(default_callbacks()),
+  nodelay_(false),
+  corked_(false),
+  fast_recovery(false),
+  reno_fpack_seen(false),
+  limited_tx_(true),
+  sack_perm(false),
+  wscale_perm(false),
+  syn_cookie(false),
+  ecn_ok(false),
+  ecn_echo(false),
+  ecn_cwr(false),
+  ecn_cut(false)
 {
   setup_congestion_control();
 }
 
+const std::shared_ptr<Connection::Callbacks>& Connection::default_callbacks() {
+  static const auto defaults = std::make_shared<Callbacks>();
+  return defaults;
+}
+
+void Connection::setup_congestion_control() {
+  set_congestion_control(host_.congestion_control());
+}
+
+void Connection::set_congestion_control(Congestion algorithm) {
+  if(algorithm == TCP::NEWRENO)
+    use_congestion_control(&Congestion_control::newreno());
+  else
+    set_congestion_control(Congestion_control::create(algorithm));
+}
+
+void Connection::set_congestion_control(std::unique_ptr<Congestion_control> cc) {
+  Expects(cc != nullptr);
+  use_congestion_control(cc.release());
+}
+
+void Connection::use_congestion_control(Congestion_control* cc) {
+  cc_.reset(cc);
+  cc_->init(*this);
+  debug("<TCP::Connection::set_congestion_control> %s\n", cc_->name());
+}
+
+void Connection::Cc_deleter::operator()(Congestion_control* cc) const {
+  if(cc != &Congestion_control::newreno())
+    delete cc;
+}
+
 /*
   This is most likely used in a PASSIVE open
 */
@@ -55,19 +105,27 @@ Connection::Connection(TCP& host, Port local_port)
 }
 
 void Connection::read(ReadBuffer buffer, ReadCallback callback) {
-  try {
-    state_->receive(*this, buffer);
-    read_request.callback = callback;
-  }
-  catch (TCPException err) {
+  if(state_->receive(*this, buffer) != Error::NONE) {
     callback(buffer.buffer, buffer.size());
+    return;
+  }
+  cold_->read_request.callback = callback;
+  cold_->rcv_payload.callback.reset();
+  // what arrived before the application got the connection
+  if(!cold_->rcv_payload.chain.empty()) {
+    Payload_chain held{std::move(cold_->rcv_payload.chain)};
+    held.conn_ = shared_from_this();
+    size_t left = held.size();
+    for(auto& payload : held)
+      receive(payload.data, payload.length, --left == 0);
   }
 }
 
 size_t Connection::receive(const uint8_t* data, size_t n, bool PUSH) {
   // should not be called without an read request
-  assert(read_request.buffer.capacity());
+  assert(cold_ and cold_->read_request.buffer.capacity());
   assert(n);
+  auto& read_request = cold_->read_request;
   auto& buf = read_request.buffer;
   size_t received{0};
   while(n) {
@@ -98,23 +156,150 @@ size_t Connection::receive(const uint8_t* data, size_t n, bool PUSH) {
   return received;
 }
 
+void Connection::receive_in_order(Packet_ptr packet, const uint8_t* data, size_t n, bool PUSH) {
+  cb.RCV.NXT += n;
+  // not handed over yet, keep it for the first read
+  if(accept_ != Accept::done) {
+    receive_payload(packet, data, n, PUSH);
+    if(accept_ == Accept::deferred)
+      hand_over();
+    return;
+  }
+  // nobody reading
+  if(!cold_)
+    return;
+  if(cold_->rcv_payload.callback) {
+    receive_payload(packet, data, n, PUSH);
+    tune_receive_window(n);
+  }
+  else if(cold_->read_request.buffer.capacity()) {
+    auto received = receive(data, n, PUSH);
+    Ensures(received == n);
+    tune_receive_window(n);
+  }
+}
+
+void Connection::read_payload(size_t n, PayloadCallback callback) {
+  Expects(n);
+  // nothing is copied anymore, replace the read buffer with an empty one
+  ReadBuffer none{buffer_t(), 0};
+  if(state_->receive(*this, none) != Error::NONE) {
+    Payload_chain empty;
+    callback(empty);
+    return;
+  }
+  cold_->rcv_payload.callback = callback;
+  cold_->rcv_payload.max = n;
+  // what arrived before the application got the connection
+  deliver_payload();
+}
 
-void Connection::write(WriteBuffer buffer, WriteCallback callback) {
-  try {
-    // try to write
-    auto written = state_->send(*this, buffer);
-    debug("<Connection::write> off=%u rem=%u  written=%u\n",
-      buffer.offset, buffer.remaining, written);
-    // put request in line
-    writeq.push_back({buffer, callback});
-    // if data was written, advance
-    if(written) {
-      writeq.advance(written);
+void Connection::receive_payload(Packet_ptr packet, const uint8_t* data, size_t n, bool PUSH) {
+  auto& rcv_payload = cold().rcv_payload;
+  auto& chain = rcv_payload.chain;
+  chain.views_.push_back({packet, data, n});
+  chain.bytes_ += n;
+  auto& target = cold_->rcv_tune.target;
+  if(!target)
+    target = cb.RCV.WND + rcv_payload.held;
+  // RCV.NXT moved, keep the right edge of the window where it was
+  const auto held = std::min((uint32_t)n, cb.RCV.WND);
+  cb.RCV.WND -= held;
+  chain.held_ += held;
+  rcv_payload.held += held;
+
+  if(rcv_payload.callback and (PUSH or chain.bytes_ >= rcv_payload.max))
+    deliver_payload();
+}
+
+void Connection::deliver_payload() {
+  auto& rcv_payload = cold_->rcv_payload;
+  if(rcv_payload.chain.empty())
+    return;
+  Payload_chain chain{std::move(rcv_payload.chain)};
+  chain.conn_ = shared_from_this();
+  debug2("<TCP::Connection::deliver_payload> %u bytes in %u packets\n",
+         chain.bytes(), chain.size());
+  rcv_payload.callback(chain);
+}
+
+void Connection::release_payload(uint32_t bytes) {
+  const auto was = cb.RCV.WND;
+  auto& held = cold().rcv_payload.held;
+  held -= std::min(bytes, held);
+  // never past the tuned window, whatever was tuned while this was held
+  cb.RCV.WND = std::min(cb.RCV.WND + bytes, cold_->rcv_tune.target);
+  debug2("<TCP::Connection::release_payload> %u bytes, RCV.WND: %u\n", bytes, cb.RCV.WND);
+  // tell the peer once it can send a full segment again [RFC 1122 4.2.3.3]
+  if(was < SMSS() and cb.RCV.WND >= SMSS() and is_connected())
+    send_ack();
+}
+
+void Connection::Payload_chain::release() {
+  if(auto conn = conn_.lock())
+    conn->release_payload(held_);
+  forget();
+}
+
+void Connection::tune_receive_window(uint32_t consumed) {
+  auto& rcv_tune = cold().rcv_tune;
+  rcv_tune.bytes += consumed;
+  auto now = Clock::now();
+  if(now - rcv_tune.time < rttm.SRTT())
+    return;
+
+  if(rcv_tune.bytes > rcv_tune.space) {
+    rcv_tune.space = rcv_tune.bytes;
+    // without scaling, there's nothing to gain above 64K
+    const uint32_t max = cb.RCV.wind_shift ? TCP::max_window_size : TCP::default_window_size;
+    const uint32_t wnd = std::min((uint64_t)rcv_tune.space * 2, (uint64_t)max);
+    const uint32_t held = cold_->rcv_payload.held;
+    if(!rcv_tune.target)
+      rcv_tune.target = cb.RCV.WND + held;
+    // never shrink the window
+    if(wnd > rcv_tune.target) {
+      rcv_tune.target = wnd;
+      cb.RCV.WND = wnd > held ? wnd - held : 0;
+      debug2("<TCP::Connection::tune_receive_window> target: %u RCV.WND: %u\n",
+             rcv_tune.target, cb.RCV.WND);
+    }
+  }
+  rcv_tune.bytes = 0;
+  rcv_tune.time = now;
+}
+
+void Connection::drain_reassembly_queue() {
+  while(!reassq.empty() and seq_leq(reassq.front().begin, cb.RCV.NXT)) {
+    auto& seg = reassq.front();
+    if(seq_lt(cb.RCV.NXT, seg.end)) {
+      auto skip = cb.RCV.NXT - seg.begin;
+      receive_in_order(seg.packet, seg.data() + skip, seg.length() - skip, seg.packet->isset(PSH));
     }
+    reassq.pop_front();
   }
-  catch(TCPException err) {
+  debug2("<TCP::Connection::drain_reassembly_queue> RCV.NXT: %u Queued: %u (%u bytes)\n",
+         cb.RCV.NXT, reassq.size(), reassq.bytes());
+}
+
+void Connection::write(WriteBuffer buffer, WriteCallback callback) {
+  // try to write
+  auto written = state_->send(*this, buffer);
+  if(!written) {
+    debug("<Connection::write> %s\n", error_string(written.error()));
     callback(0);
+    return;
   }
+  debug("<Connection::write> off=%u rem=%u  written=%u\n",
+    buffer.offset, buffer.remaining, *written);
+  // put request in line
+  writeq.push_back({buffer, callback});
+  // if data was written, advance
+  if(*written) {
+    writeq.advance(*written);
+  }
+  // the rest waits for its turn
+  if(is_writable())
+    writeq_push();
 }
 
 void Connection::offer(size_t& packets) {
@@ -130,19 +315,15 @@ void Connection::offer(size_t& packets) {
     auto packet = create_outgoing_packet();
     packets--;
 
-    // get next request in writeq
-    auto& buf = writeq.nxt();
-    // fill the packet with data
-    auto written = fill_packet(packet, (char*)buf.pos(), buf.remaining, cb.SND.NXT);
-    cb.SND.NXT += packet->data_length();
-
-    // advance the write q
-    writeq.advance(written);
+    // fill the packet with data, from as many requests as needed
+    auto written = fill_from_writeq(packet);
 
     debug2("<TCP::Connection::offer> Wrote %u bytes (%u remaining) with [%u] packets left and a usable window of %u.\n",
-           written, buf.remaining, packets, usable_window());
+           written, writeq.unsent - written, packets, usable_window());
 
     transmit(packet);
+    // advance the write q, after transmit since callbacks may write
+    writeq.advance(written);
   }
 
   debug("<TCP::Connection::offer> Finished working offer with [%u] packets left and a queue of (%u) with a usable window of %i\n",
@@ -157,18 +338,25 @@ size_t Connection::send(const char* buffer, size_t remaining, size_t& packets_av
 
   std::vector<Packet_ptr> packets;
 
-  while(remaining and usable_window() >= SMSS() and packets_avail)
+  while(remaining and usable_window() >= SMSS() and packets_avail and !pacing_hold())
   {
+    // Nagle: hold back a small tail, it goes out with the next ACK
+    if(remaining < effective_mss() and !may_send_small())
+      break;
+
     auto packet = create_outgoing_packet();
     packets_avail--;
 
     auto written = fill_packet(packet, buffer+bytes_written, remaining, cb.SND.NXT);
     cb.SND.NXT += packet->data_length();
+    if(ecn_ok)
+      ecn_mark(packet);
 
     bytes_written += written;
     remaining -= written;
 
-    if(!remaining or usable_window() < SMSS() or !packets_avail)
+    // the last byte written so far, as in fill_from_writeq
+    if(!remaining and !writeq.unsent)
       packet->set_flag(PSH);
 
     transmit(packet);
@@ -213,19 +401,15 @@ void Connection::make_flight_ready(Packet_ptr packet) {
 }*/
 
 void Connection::writeq_push() {
-  while(writeq.remaining_requests()) {
-    auto& buf = writeq.nxt();
-    auto written = host_.send(shared_from_this(), (char*)buf.pos(), buf.remaining);
-    writeq.advance(written);
-    if(buf.remaining)
-      return;
-  }
+  if(writeq.remaining_requests())
+    host_.request_offer(shared_from_this());
 }
 
 size_t Connection::fill_packet(Packet_ptr packet, const char* buffer, size_t n, Seq seq) {
   Expects(!packet->has_data());
 
-  auto written = packet->fill(buffer, std::min(n, (size_t)SMSS()));
+  // options take room from the payload [RFC 6691]
+  auto written = packet->fill(buffer, std::min(n, (size_t)SMSS() - packet->options_length()));
 
   packet->set_seq(seq).set_ack(cb.RCV.NXT).set_flag(ACK);
 
@@ -234,20 +418,35 @@ size_t Connection::fill_packet(Packet_ptr packet, const char* buffer, size_t n,
   return written;
 }
 
+size_t Connection::fill_from_writeq(Packet_ptr packet) {
+  Expects(!packet->has_data() and writeq.remaining_requests());
+
+  // options take room from the payload [RFC 6691]
+  auto written = writeq.peek(*packet, (size_t)SMSS() - packet->options_length());
+
+  packet->set_seq(cb.SND.NXT).set_ack(cb.RCV.NXT).set_flag(ACK);
+  cb.SND.NXT += written;
+  if(ecn_ok)
+    ecn_mark(packet);
+
+  // everything the user has written so far is in this segment
+  if(written == writeq.unsent)
+    packet->set_flag(PSH);
+
+  return written;
+}
+
 void Connection::limited_tx() {
 
   auto packet = create_outgoing_packet();
 
   debug("<Connection::limited_tx> UW: %u CW: %u, FS: %u\n", usable_window(), cb.cwnd, flight_size());
 
-  auto& buf = writeq.nxt();
+  auto written = fill_from_writeq(packet);
 
-  auto written = fill_packet(packet, (char*)buf.pos(), buf.remaining, cb.SND.NXT);
-  cb.SND.NXT += packet->data_length();
+  transmit(packet);
 
   writeq.advance(written);
-
-  transmit(packet);
 }
 
 void Connection::writeq_reset() {
@@ -256,26 +455,178 @@ void Connection::writeq_reset() {
 }
 
 void Connection::open(bool active) {
-  try {
-    debug("<TCP::Connection::open> Trying to open Connection...\n");
-    state_->open(*this, active);
-  }
+  debug("<TCP::Connection::open> Trying to open Connection...\n");
+  auto err = state_->open(*this, active);
   // No remote host, or state isnt valid for opening.
-  catch (TCPException e) {
+  if(err != Error::NONE) {
     debug("<TCP::Connection::open> Cannot open Connection. \n");
-    signal_error(e);
+    signal_error(err);
+  }
+}
+
+void Connection::inherit(const Connection& listener) {
+  callbacks_ = listener.callbacks_;
+  nodelay_ = listener.nodelay_;
+  delack.quick = listener.delack.quick;
+  idle_.keepalive = listener.idle_.keepalive;
+  idle_.timeout = listener.idle_.timeout;
+  if(listener.paced())
+    set_pacing(true, listener.cold_->pacing.rate);
+}
+
+void Connection::signal_established() {
+  if(accept_ == Accept::done) {
+    signal_connect();
+    return;
+  }
+  auto& listener = host_.listeners_[local_port_];
+  // nothing yet, wait for it with the listener's timeout instead of its own
+  if(listener and listener->defer_accept().count() and cb.RCV.NXT == cb.IRS + 1) {
+    accept_ = Accept::deferred;
+    idle_.timeout = listener->cold_->defer_accept;
+    return;
+  }
+  hand_over();
+}
+
+void Connection::hand_over() {
+  auto& listener = host_.listeners_[local_port_];
+  if(accept_ == Accept::deferred)
+    idle_.timeout = listener ? listener->idle_.timeout : 0;
+
+  if(listener and listener->backlog()) {
+    accept_ = Accept::queued;
+    auto& cold = listener->cold();
+    cold.accept_queue.push_back(shared_from_this());
+    debug("<TCP::Connection::hand_over> %s queued (%u)\n",
+          to_string().c_str(), cold.accept_queue.size());
+    if(cold.on_acceptable)
+      cold.on_acceptable(*listener);
+    return;
   }
+  accept_ = Accept::done;
+  signal_connect();
+}
+
+TCP::Connection_ptr Connection::accept() {
+  while(cold_ and !cold_->accept_queue.empty()) {
+    auto conn = std::move(cold_->accept_queue.front());
+    cold_->accept_queue.pop_front();
+    // reset or timed out while waiting
+    auto* found = host_.connections_.find(conn->tuple());
+    if(!found or found->get() != conn.get())
+      continue;
+    conn->accept_ = Accept::done;
+    conn->signal_connect();
+    return conn;
+  }
+  return nullptr;
+}
+
+void Connection::accept_handshake(const Half_open& h) {
+  cb.IRS = h.irs;
+  cb.RCV.NXT = h.irs + 1;
+  cb.ISS = h.iss;
+  cb.SND.UNA = h.iss;
+  cb.SND.NXT = h.iss + 1;
+  cb.recover = h.iss; // [RFC 6582]
+  cb.SND.MSS = h.mss;
+  cb.SND.WND = h.wnd;
+  cb.SND.WL1 = h.irs;
+  cb.SND.WL2 = h.iss;
+
+  if(h.wscale != Half_open::no_wscale) {
+    wscale_perm = true;
+    cb.SND.wind_shift = h.wscale;
+    cb.RCV.wind_shift = TCP::default_window_shift;
+  }
+  sack_perm = h.sack;
+  syn_cookie = h.cookie;
+  ecn_ok = h.ecn;
+  if(h.ts) {
+    ts.ok = true;
+    ts.recent = h.ts_recent;
+  }
+  // again, now that the MSS is known
+  cc_->init(*this);
+  accept_ = Accept::pending;
+  set_state(SynReceived::instance());
+}
+
+void Connection::fastopen_accepted(TCP::Packet_ptr syn) {
+  // held for the first read, like anything before the hand over
+  const auto n = std::min((uint32_t)syn->data_length(), cb.RCV.WND);
+  if(n)
+    receive_in_order(syn, (uint8_t*)syn->data(), n, syn->isset(PSH));
+  send_synack();
+  // no half-open entry to retransmit it from
+  rtx_start();
+  hand_over();
+}
+
+void Connection::fastopen_acked() {
+  writeq.acknowledge(cb.SND.UNA - (cb.ISS + 1));
+  if(cb.SND.UNA == cb.SND.NXT and rtx_timer.active) {
+    rtx_stop();
+    rto_attempt = 0;
+  }
+}
+
+void Connection::send_syn(bool first) {
+  auto packet = outgoing_packet();
+  packet->set_seq(cb.ISS).set_flag(SYN);
+  packet->set_win(advertised_window(true));
+  // offer ECN [RFC 3168]
+  if(host_.ecn())
+    packet->set_flag(ECE).set_flag(CWR);
+
+  add_option(Option::MSS, packet);
+  add_option(Option::WS, packet);
+  add_option(Option::SACK_PERM, packet);
+  add_option(Option::TS, packet);
+
+  if(first and writeq.remaining_requests()) {
+    if(auto* cookie = host_.fastopen_lookup(remote_.address())) {
+      packet->add_option<Option::opt_fastopen>(cookie->data, cookie->length);
+      // the peer's MSS is still unknown, options take room from the payload [RFC 6691]
+      const auto n = writeq.peek(*packet, TCP::default_mss - packet->options_length());
+      cb.SND.NXT += n;
+      transmit(packet);
+      writeq.advance(n);
+      return;
+    }
+    // ask for a cookie, for the next time
+    packet->add_option<Option::opt_fastopen>(nullptr, 0);
+  }
+  transmit(packet);
+}
+
+void Connection::send_synack() {
+  auto packet = outgoing_packet();
+  packet->set_seq(cb.ISS).set_ack(cb.RCV.NXT).set_flags(SYN | ACK);
+  packet->set_win(advertised_window(true));
+
+  // ECN agreed on [RFC 3168]
+  if(ecn_ok)
+    packet->set_flag(ECE);
+
+  add_option(Option::MSS, packet);
+  // scale our window only if the remote scales its own [RFC 7323 p. 9]
+  if(wscale_perm)
+    add_option(Option::WS, packet);
+  if(sack_perm)
+    add_option(Option::SACK_PERM, packet);
+
+  transmit(packet);
 }
 
 void Connection::close() {
   debug("<TCP::Connection::close> Active close on connection. \n");
-  try {
-    state_->close(*this);
-    if(is_state(Closed::instance()))
-      signal_close();
-  } catch(TCPException err) {
+  auto err = state_->close(*this);
+  if(err != Error::NONE)
     signal_error(err);
-  }
+  else if(is_state(Closed::instance()))
+    signal_close();
 }
 
 /*
@@ -291,19 +642,24 @@ void Connection::segment_arrived(TCP::Packet_ptr incoming) {
 
   signal_packet_received(incoming);
 
-  if(incoming->has_options()) {
-    try {
-      parse_options(incoming);
-    }
-    catch(TCPBadOptionException err) {
-      debug("<TCP::Connection::receive> %s \n", err.what());
-    }
-  }
+  // anything from the peer will do to show it's alive
+  idle_.last = host_.idle_tick_;
+  idle_.probes = 0;
+
+  ts.seen = false;
+
+  if(incoming->has_options())
+    parse_options(incoming);
+
+  if(ecn_ok)
+    ecn_received(incoming);
 
   // Let state handle what to do when incoming packet arrives, and modify the outgoing packet.
   switch(state_->handle(*this, incoming)) {
   case State::OK: {
-    // Do nothing.
+    // might have just connected
+    if(!idle_.armed)
+      idle_arm();
     break;
   }
   case State::CLOSED: {
@@ -329,6 +685,8 @@ Connection::~Connection() {
   // Do all necessary clean up.
   // Free up buffers etc.
   debug2("<TCP::Connection::~Connection> Bye bye... \n");
+  if(delack.active)
+    delack_stop();
 }
 
 
@@ -342,17 +700,28 @@ TCP::Packet_ptr Connection::create_outgoing_packet() {
   // Set Destination (remote)
   packet->set_destination(remote_);
 
-  packet->set_win(cb.RCV.WND);
+  packet->set_win(advertised_window());
 
   // Set SEQ and ACK - I think this is OK..
   packet->set_seq(cb.SND.NXT).set_ack(cb.RCV.NXT);
+
+  // the network marked what the peer sent
+  if(ecn_echo)
+    packet->set_flag(ECE);
+
+  // Timestamps go in every segment once agreed on [RFC 7323 p. 13]
+  if(ts.ok) {
+    add_option(Option::TS, packet);
+    ts.last_ack_sent = cb.RCV.NXT;
+  }
   debug("<TCP::Connection::create_outgoing_packet> Outgoing packet created: %s \n", packet->to_string().c_str());
 
   return packet;
 }
 
 void Connection::transmit(TCP::Packet_ptr packet) {
-  if(!rttm.active and packet->end() == cb.SND.NXT) {
+  // with timestamps, every ACK is a measurement
+  if(!ts.ok and !rttm.active and packet->end() == cb.SND.NXT) {
     //printf("<TCP::Connection::transmit> Starting RTT measurement.\n");
     rttm.start();
   }
@@ -362,6 +731,9 @@ void Connection::transmit(TCP::Packet_ptr packet) {
   debug2("<TCP::Connection::transmit> TX %s\n", packet->to_string().c_str());
 
   host_.transmit(packet);
+  ack_sent(packet);
+  if(paced())
+    cold_->pacing.credit -= packet->data_length();
   if(packet->has_data() and !rtx_timer.active) {
     rtx_start();
   }
@@ -372,7 +744,47 @@ bool Connection::can_send_one() {
 }
 
 bool Connection::can_send() {
-  return (usable_window() >= SMSS()) and writeq.remaining_requests();
+  return (usable_window() >= SMSS()) and writeq.remaining_requests()
+    and (writeq.unsent >= effective_mss() or may_send_small())
+    and !pacing_hold();
+}
+
+bool Connection::pacing_hold() {
+  const auto rate = pacing_rate();
+  if(!rate)
+    return false;
+
+  auto& pacing = cold_->pacing;
+  const auto now = Clock::now();
+  if(now != pacing.last) {
+    // a millisecond's worth may go at once, the timer does no finer
+    const int64_t burst = std::max(rate / 1000, (uint32_t)SMSS());
+    const int64_t credit = pacing.credit + (int64_t)rate * (now - pacing.last) / 1000;
+    pacing.credit = std::min(credit, burst);
+    pacing.last = now;
+  }
+  if(pacing.credit > 0)
+    return false;
+
+  if(!pacing.waiting) {
+    pacing.waiting = true;
+    host_.pace(shared_from_this());
+  }
+  return true;
+}
+
+uint32_t Connection::pacing_rate() const {
+  if(!paced())
+    return 0;
+  if(cold_->pacing.rate)
+    return cold_->pacing.rate;
+  if(auto rate = cc_->pacing_rate())
+    return rate;
+  if(!rttm.measured)
+    return 0;
+  // twice the window per RTT in slow start, and 1.2 times after
+  const uint32_t gain = (cb.cwnd < cb.ssthresh) ? 200 : 120;
+  return (uint64_t)cb.cwnd * gain * 10 / std::max(rttm.SRTT(), (uint32_t)1);
 }
 
 void Connection::send_much() {
@@ -388,7 +800,7 @@ bool Connection::handle_ack(TCP::Packet_ptr in) {
     4. is not an wnd update
   */
   if(in->ack() == cb.SND.UNA and flight_size()
-    and !in->has_data() and cb.SND.WND == in->win()
+    and !in->has_data() and cb.SND.WND == segment_window(in)
     and !in->isset(SYN) and !in->isset(FIN))
   {
     dup_acks_++;
@@ -401,15 +813,13 @@ bool Connection::handle_ack(TCP::Packet_ptr in) {
 
     if( cb.SND.WL1 < in->seq() or ( cb.SND.WL1 == in->seq() and cb.SND.WL2 <= in->ack() ) )
     {
-      cb.SND.WND = in->win();
+      cb.SND.WND = segment_window(in);
       cb.SND.WL1 = in->seq();
       cb.SND.WL2 = in->ack();
       //printf("<Connection::handle_ack> Window update (%u)\n", cb.SND.WND);
     }
 
-    acks_rcvd_++;
-
-    debug("<Connection::handle_ack> New ACK#%u: %u FS: %u %s\n", acks_rcvd_,
+    debug("<Connection::handle_ack> New ACK: %u FS: %u %s\n",
       in->ack() - cb.ISS, flight_size(), fast_recovery ? "[RECOVERY]" : "");
 
     // [RFC 6582] p. 8
@@ -420,18 +830,17 @@ bool Connection::handle_ack(TCP::Packet_ptr in) {
     size_t bytes_acked = in->ack() - cb.SND.UNA;
     cb.SND.UNA = in->ack();
 
+    if(!scoreboard.empty())
+      scoreboard.acknowledge(cb.SND.UNA);
+
     // ack everything in write queue
     if(!writeq.empty())
       rtx_ack(in->ack());
 
-    // update cwnd when congestion avoidance?
-    bool cong_avoid_rtt = false;
-
-    // if measuring round trip time, stop
-    if(rttm.active) {
-      rttm.stop();
-      cong_avoid_rtt = true;
-    }
+    // RTT from the echoed timestamp [RFC 7323 p. 14],
+    // or stop measuring round trip time
+    if(bytes_acked or !ts.ok)
+      rtt_sample();
 
     // no fast recovery
     if(!fast_recovery) {
@@ -439,23 +848,18 @@ bool Connection::handle_ack(TCP::Packet_ptr in) {
       dup_acks_ = 0;
       cb.recover = cb.SND.NXT;
 
-      // slow start
-      if(cb.slow_start()) {
-        reno_increase_cwnd(bytes_acked);
-        debug2("<Connection::handle_ack> Slow start. cwnd=%u uw=%u\n",
-          cb.cwnd, usable_window());
+      // marked instead of dropped, and no growth for it [RFC 3168]
+      if(ecn_ok and cc_->on_ecn(*this, bytes_acked, in->isset(ECE))) {
+        ecn_cwr = true;
+        debug("<Connection::handle_ack> ECN-Echo, cwnd=%u\n", cb.cwnd);
+      }
+      else if(bytes_acked) {
+        cc_->on_ack(*this, bytes_acked);
+        debug2("<Connection::handle_ack> %s cwnd=%u uw=%u\n",
+          cc_->name(), cb.cwnd, usable_window());
       }
-
-      // congestion avoidance
-      else {
-        // increase cwnd once per RTT
-        cb.cwnd += std::max(SMSS()*SMSS()/cb.cwnd, (uint32_t)1);
-        debug2("<Connection::handle_ack> Congestion avoidance. cwnd=%u uw=%u\n",
-          cb.cwnd, usable_window());
-      } // < congestion avoidance
 
       // try to write
-      //if(can_send() and acks_rcvd_ % 2 == 1)
       if(can_send())
         send_much();
 
@@ -465,6 +869,21 @@ bool Connection::handle_ack(TCP::Packet_ptr in) {
 
     } // < !fast recovery
 
+    // we're in SACK loss recovery [RFC 6675 p. 9]
+    else if(sack_perm) {
+      if(seq_leq(cb.recover, in->ack())) {
+        debug("<Connection::handle_ack> SACK recovery done.\n");
+        dup_acks_ = 0;
+        finish_fast_recovery();
+      }
+      else {
+        sack_send();
+      }
+
+      if(in->has_data() or in->isset(FIN))
+        return true;
+    } // < SACK recovery
+
     // we're in fast recovery
     else {
       //printf("<Connection::handle_ack> In Recovery\n");
@@ -519,6 +938,10 @@ bool Connection::handle_ack(TCP::Packet_ptr in) {
 */
 void Connection::on_dup_ack() {
   debug2("<TCP::Connection::on_dup_ack> rack=%u i=%u\n", cb.SND.UNA - cb.ISS, dup_acks_);
+  if(sack_perm) {
+    sack_on_dup_ack();
+    return;
+  }
   // if less than 3 dup acks
   if(dup_acks_ < 3) {
 
@@ -552,6 +975,195 @@ void Connection::on_dup_ack() {
   }
 }
 
+/*
+  [RFC 6675] p. 8
+
+  Loss recovery starts on the third duplicate ACK, or as soon as the
+  scoreboard says SND.UNA is lost. Until then, limited transmit.
+*/
+void Connection::sack_on_dup_ack() {
+  if(fast_recovery) {
+    sack_send();
+  }
+  else if(dup_acks_ >= Scoreboard::dup_thresh or scoreboard.is_lost(cb.SND.UNA, SMSS())) {
+    sack_enter_recovery();
+  }
+  else if(limited_tx_ and cb.SND.WND >= SMSS()
+    and flight_size() <= cb.cwnd + 2*SMSS() and writeq.remaining_requests())
+  {
+    limited_tx();
+  }
+}
+
+void Connection::sack_enter_recovery() {
+  cb.recover = cb.SND.NXT; // RecoveryPoint
+  cc_->on_loss(*this);
+  fast_recovery = true;
+  debug("<TCP::Connection::sack_enter_recovery> Enter Recovery - Flight Size: %u Blocks: %u\n",
+    flight_size(), scoreboard.blocks.size());
+
+  // the first segment is lost either way
+  uint32_t len = SMSS();
+  if(!scoreboard.empty())
+    len = std::min(len, scoreboard.blocks.front().left - cb.SND.UNA);
+  high_rxt = cb.SND.UNA + retransmit(cb.SND.UNA, len);
+
+  sack_send();
+}
+
+/*
+  SetPipe() [RFC 6675 p. 7]
+
+  Everything in a hole counts, unless it's lost, in which case it only
+  counts if it has been retransmitted. Whether a sequence is lost depends
+  only on what is SACKed above it, so it's the same for a whole hole.
+*/
+uint32_t Connection::sack_pipe() const {
+  uint32_t pipe = 0;
+  auto hole = [this, &pipe](Seq left, Seq right)
+  {
+    if(!seq_lt(left, right))
+      return;
+    if(!scoreboard.is_lost(left, SMSS()))
+      pipe += right - left;
+    if(seq_lt(left, high_rxt))
+      pipe += (seq_lt(high_rxt, right) ? high_rxt : right) - left;
+  };
+  Seq seq = cb.SND.UNA;
+  for(auto& b : scoreboard.blocks) {
+    hole(seq, b.left);
+    seq = b.right;
+  }
+  hole(seq, cb.SND.NXT);
+  return pipe;
+}
+
+bool Connection::sack_next_hole(Seq& seq, uint32_t& len, bool& lost) const {
+  bool found = false;
+  Seq left = cb.SND.UNA;
+  for(auto& b : scoreboard.blocks) {
+    // never retransmit the same thing twice
+    if(seq_lt(left, high_rxt))
+      left = high_rxt;
+    if(seq_lt(left, b.left)) {
+      // (1) lost, and not yet retransmitted
+      if(scoreboard.is_lost(left, SMSS())) {
+        seq = left;
+        len = std::min((uint32_t)SMSS(), b.left - left);
+        lost = true;
+        return true;
+      }
+      // (3) not SACKed, below the highest SACKed sequence
+      if(!found) {
+        seq = left;
+        len = std::min((uint32_t)SMSS(), b.left - left);
+        found = true;
+      }
+    }
+    left = b.right;
+  }
+  lost = false;
+  return found;
+}
+
+void Connection::sack_send() {
+  auto pipe = sack_pipe();
+  debug2("<TCP::Connection::sack_send> cwnd=%u pipe=%u\n", cb.cwnd, pipe);
+
+  while(cb.cwnd >= pipe + SMSS()) {
+    Seq seq;
+    uint32_t len;
+    bool lost;
+    bool hole = sack_next_hole(seq, len, lost);
+
+    // (2) new data, if the receive window allows
+    if(!lost and writeq.remaining_requests() and flight_size() + SMSS() <= cb.SND.WND) {
+      auto nxt = cb.SND.NXT;
+      limited_tx();
+      if(cb.SND.NXT == nxt)
+        break;
+      pipe += cb.SND.NXT - nxt;
+      continue;
+    }
+    if(!hole)
+      break;
+
+    auto sent = retransmit(seq, len);
+    if(!sent)
+      break;
+    high_rxt = seq + sent;
+    pipe += sent;
+  }
+}
+
+void Connection::send_ack() {
+  auto packet = create_outgoing_packet();
+  packet->set_seq(cb.SND.NXT).set_ack(cb.RCV.NXT).set_flag(ACK);
+  if(sack_perm and !reassq.empty())
+    add_option(Option::SACK, packet);
+  transmit(packet);
+}
+
+void Connection::ecn_received(TCP::Packet_ptr in) {
+  const bool ce = in->ecn() == PacketIP4::CE;
+  if(cc_->ecn_per_segment()) {
+    // what came before is ACKed with the old state first
+    if(ce != ecn_echo and delack.active)
+      send_ack();
+    ecn_echo = ce;
+    return;
+  }
+  // from CE until the peer says it reduced cwnd [RFC 3168]
+  if(in->isset(CWR))
+    ecn_echo = false;
+  if(ce)
+    ecn_echo = true;
+}
+
+void Connection::ecn_mark(TCP::Packet_ptr packet) {
+  // new data only, never retransmissions or pure ACKs [RFC 3168]
+  packet->set_ecn(PacketIP4::ECT0);
+  if(ecn_cwr) {
+    packet->set_flag(CWR);
+    ecn_cwr = false;
+  }
+}
+
+void Connection::ack_data(uint16_t length, bool now) {
+  delack.rcv_mss = std::max(delack.rcv_mss, std::min(length, SMSS()));
+  // already went out with data sent from the user callback
+  if(delack.acked == cb.RCV.NXT)
+    return;
+  if(delack.quickacks) {
+    delack.quickacks--;
+    now = true;
+  }
+  // at least every second full-sized segment [RFC 5681 p. 11]
+  if(now or delack.quick or cb.RCV.NXT - delack.acked >= 2u * delack.rcv_mss) {
+    send_ack();
+  }
+  else if(!delack.active) {
+    delack_start();
+  }
+}
+
+void Connection::delack_start() {
+  delack.iter = hw::PIT::instance().onTimeout(std::chrono::milliseconds(delack_ms),
+  [this]
+  {
+    delack.active = false;
+    debug2("<TCP::Connection::delack@timeout> ACK %u\n", cb.RCV.NXT);
+    send_ack();
+  });
+  delack.active = true;
+}
+
+void Connection::delack_stop() {
+  Expects(delack.active);
+  hw::PIT::instance().stop_timer(delack.iter);
+  delack.active = false;
+}
+
 /*
   [RFC 6298]
 
@@ -588,14 +1200,20 @@ void Connection::rtx_ack(const Seq ack) {
 }
 
 
-void Connection::retransmit() {
+size_t Connection::retransmit(Seq seq, size_t len) {
   auto packet = create_outgoing_packet();
-  auto& buf = writeq.una();
-  fill_packet(packet, (char*)buf.pos(), buf.remaining, cb.SND.UNA);
+  size_t avail;
+  auto* data = writeq.at(seq - writeq_start(), avail);
+  size_t written = 0;
+  if(data)
+    written = fill_packet(packet, (char*)data, std::min(avail, len), seq);
+  else
+    packet->set_seq(seq).set_ack(cb.RCV.NXT);
   packet->set_flag(ACK);
   //printf("<TCP::Connection::retransmit> rseq=%u \n", packet->seq() - cb.ISS);
   debug("<TCP::Connection::retransmit> RT %s\n", packet->to_string().c_str());
   host_.transmit(packet);
+  ack_sent(packet);
   /*
     Every time a packet containing data is sent (including a
     retransmission), if the timer is not running, start it running
@@ -605,21 +1223,20 @@ void Connection::retransmit() {
   if(packet->has_data() and !rtx_timer.active) {
     rtx_start();
   }
+  return written;
 }
 
 void Connection::rtx_start() {
   Expects(!rtx_timer.active);
-  auto i = rtx_timer.i;
   auto rto = rttm.RTO;
-  rtx_timer.iter = hw::PIT::instance().on_timeout(rttm.RTO,
-  [this, i, rto]
+  rtx_timer.iter = hw::PIT::instance().onTimeout(std::chrono::milliseconds(rto),
+  [this, rto]
   {
     rtx_timer.active = false;
-    debug("<TCP::Connection::RTX@timeout> %s Timed out (%f). FS: %u, i: %u rt_i: %u\n",
-      to_string().c_str(), rto, flight_size(), i, rtx_timer.i);
+    debug("<TCP::Connection::RTX@timeout> %s Timed out (%ums). FS: %u\n",
+      to_string().c_str(), rto, flight_size());
     rtx_timeout();
   });
-  rtx_timer.i++;
   rtx_timer.active = true;
 }
 
@@ -654,17 +1271,25 @@ void Connection::rtx_clear() {
        begins (i.e., after the three-way handshake completes).
 */
 void Connection::rtx_timeout() {
+  // still in the handshake: our SYN (without data) or SYN-ACK again,
+  // anything sent with it follows the handshake
+  if(is_state(SynSent::instance()) or is_state(SynReceived::instance())) {
+    if(is_state(SynSent::instance()))
+      send_syn(false);
+    else
+      send_synack();
+    rttm.backoff();
+    if(!rtx_timer.active)
+      rtx_start();
+    return;
+  }
+
   // retransmit SND.UNA
   retransmit();
 
-  if(cb.SND.UNA != cb.ISS) {
-    // "back off" timer
-    rttm.RTO *= 2.0;
-  }
-  // we never queue SYN packets since they don't carry data..
-  else {
-    rttm.RTO = 3.0;
-  }
+  // "back off" timer
+  rttm.backoff();
+
   // timer need to be restarted
   if(!rtx_timer.active)
     rtx_start();
@@ -679,8 +1304,7 @@ void Connection::rtx_timeout() {
 
       ssthresh = max (FlightSize / 2, 2*SMSS)
   */
-  if(rto_attempt++ == 0)
-    reduce_ssthresh();
+  const bool first = (rto_attempt++ == 0);
 
   /*
     [RFC 6582] p. 6
@@ -695,15 +1319,19 @@ void Connection::rtx_timeout() {
   if(fast_recovery) // not sure if this is correct
     finish_fast_recovery();
 
-  cb.cwnd = SMSS();
+  // The receiver may have reneged on what it SACKed [RFC 2018 p. 9]
+  scoreboard.clear();
+  high_rxt = cb.SND.UNA;
+
+  cc_->on_rto(*this, first);
 
   /*
     NOTE: It's unclear which one comes first, or if finish_fast_recovery includes changing the cwnd.
   */
 }
 
-TCP::Seq Connection::generate_iss() {
-  return host_.generate_iss();
+TCP::Seq Connection::generate_iss() const {
+  return host_.generate_iss(tuple());
 }
 
 void Connection::set_state(State& state) {
@@ -715,18 +1343,74 @@ void Connection::set_state(State& state) {
 
 
 void Connection::start_time_wait_timeout() {
-  debug2("<TCP::Connection::start_time_wait_timeout> Time Wait timer started. \n");
-  time_wait_started = OS::cycles_since_boot();
-  auto timeout = 2 * host().MSL(); // 60 seconds
-  // Passing "this"..?
-  hw::PIT::instance().onTimeout(timeout,[this, timeout] {
-      // The timer hasnt been updated
-      if( OS::cycles_since_boot() >= (time_wait_started + timeout.count()) ) {
-        signal_close();
-      } else {
-        debug2("<TCP::Connection::start_time_wait_timeout> time_wait_started has been updated. \n");
-      }
-    });
+  debug2("<TCP::Connection::start_time_wait_timeout> Time Wait started. \n");
+  if(rtx_timer.active)
+    rtx_stop();
+  if(delack.active)
+    delack_stop();
+  writeq_reset();
+  host_.enter_time_wait(*this);
+}
+
+void Connection::idle_arm() {
+  if(idle_.armed or !(idle_.keepalive or idle_.timeout) or !is_connected())
+    return;
+  idle_.armed = true;
+  // idle from the later of the last segment, and now
+  idle_.last = host_.idle_tick_;
+  host_.idle_arm(shared_from_this(), idle_next(0));
+}
+
+uint32_t Connection::idle_next(uint16_t idle) const {
+  uint32_t next = UINT32_MAX;
+  if(idle_.timeout)
+    next = idle_.timeout > idle ? idle_.timeout - idle : 1;
+  if(idle_.keepalive) {
+    const uint32_t due = host_.keepalive_idle_ + idle_.probes * host_.keepalive_interval_;
+    next = std::min(next, due > idle ? due - idle : 1);
+  }
+  return next;
+}
+
+uint32_t Connection::idle_check(uint32_t now) {
+  // turned off, or closed but still referenced
+  auto* self = host_.connections_.find(tuple());
+  if(!(idle_.keepalive or idle_.timeout) or !self or self->get() != this) {
+    idle_.armed = false;
+    return 0;
+  }
+
+  const uint16_t idle = now - idle_.last;
+  bool expired = idle_.timeout and idle >= idle_.timeout;
+
+  if(!expired and idle_.keepalive
+     and idle >= host_.keepalive_idle_ + idle_.probes * host_.keepalive_interval_)
+  {
+    expired = idle_.probes >= host_.keepalive_probes_;
+    if(!expired) {
+      // with data in flight, the retransmissions are probes enough
+      if(cb.SND.UNA == cb.SND.NXT)
+        send_keepalive();
+      idle_.probes++;
+    }
+  }
+
+  if(expired) {
+    debug("<TCP::Connection::idle_check> Timed out after %u s idle: %s\n",
+          idle, to_string().c_str());
+    idle_.armed = false;
+    signal_disconnect(Disconnect::TIMEOUT);
+    abort();
+    return 0;
+  }
+  return idle_next(idle);
+}
+
+void Connection::send_keepalive() {
+  debug2("<TCP::Connection::send_keepalive> Probe %u\n", idle_.probes);
+  auto packet = create_outgoing_packet();
+  packet->set_seq(cb.SND.NXT - 1).set_flag(ACK);
+  transmit(packet);
 }
 
 void Connection::signal_close() {
@@ -740,6 +1424,7 @@ std::string Connection::TCB::to_string() const {
      << " .UNA = " << SND.UNA
      << " .NXT = " << SND.NXT
      << " .WND = " << SND.WND
+     << " .WS = " << (int)SND.wind_shift
      << " .UP = " << SND.UP
      << " .WL1 = " << SND.WL1
      << " .WL2 = " << SND.WL2
@@ -747,11 +1432,19 @@ std::string Connection::TCB::to_string() const {
      << "\n RCV"
      << " .NXT = " << RCV.NXT
      << " .WND = " << RCV.WND
+     << " .WS = " << (int)RCV.wind_shift
      << " .UP = " << RCV.UP
      << " IRS = " << IRS;
   return os.str();
 }
 
+// a malformed option ends parsing, the segment itself is still handled
+static void bad_option(TCP::Option::Kind kind, const char* error) {
+  (void) kind; (void) error;
+  debug("<TCP::parse_options> Bad Option [%s]: %s\n",
+        TCP::Option::kind_string(kind).c_str(), error);
+}
+
 void Connection::parse_options(TCP::Packet_ptr packet) {
   assert(packet->has_options());
   debug("<TCP::parse_options> Parsing options. Offset: %u, Options: %u \n",
@@ -777,10 +1470,10 @@ void Connection::parse_options(TCP::Packet_ptr packet) {
     case Option::MSS: {
       // unlikely
       if(option->length != 4)
-        throw TCPBadOptionException{Option::MSS, "length != 4"};
+        return bad_option(Option::MSS, "length != 4");
       // unlikely
       if(!packet->isset(SYN))
-        throw TCPBadOptionException{Option::MSS, "Non-SYN packet"};
+        return bad_option(Option::MSS, "Non-SYN packet");
 
       auto* opt_mss = (Option::opt_mss*)option;
       uint16_t mss = ntohs(opt_mss->mss);
@@ -790,8 +1483,83 @@ void Connection::parse_options(TCP::Packet_ptr packet) {
       break;
     }
 
+    case Option::WS: {
+      if(option->length != 3)
+        return bad_option(Option::WS, "length != 3");
+      if(!packet->isset(SYN))
+        return bad_option(Option::WS, "Non-SYN packet");
+
+      // [RFC 7323 p. 10] a shift above 14 is treated as 14
+      cb.SND.wind_shift = std::min(option->data[0], (uint8_t)14);
+      wscale_perm = true;
+      debug2("<TCP::parse_options@Option:WS> Shift: %u \n", cb.SND.wind_shift);
+      opt += option->length;
+      break;
+    }
+
+    case Option::TS: {
+      if(option->length != 10)
+        return bad_option(Option::TS, "length != 10");
+
+      ts.val = ntohl(*(uint32_t*)(option->data));
+      ts.ecr = ntohl(*(uint32_t*)(option->data + 4));
+      ts.seen = true;
+      if(packet->isset(SYN)) {
+        ts.ok = true;
+        ts.recent = ts.val;
+      }
+      debug2("<TCP::parse_options@Option:TS> TSval: %u TSecr: %u \n", ts.val, ts.ecr);
+      opt += option->length;
+      break;
+    }
+
+    case Option::SACK_PERM: {
+      if(option->length != 2)
+        return bad_option(Option::SACK_PERM, "length != 2");
+      if(!packet->isset(SYN))
+        return bad_option(Option::SACK_PERM, "Non-SYN packet");
+
+      sack_perm = true;
+      debug2("<TCP::parse_options@Option:SACK_PERM> SACK permitted\n");
+      opt += option->length;
+      break;
+    }
+
+    case Option::SACK: {
+      if(option->length < 10 or (option->length - 2) % 8)
+        return bad_option(Option::SACK, "bad length");
+
+      // only care about blocks of data in flight
+      for(int i = 0; sack_perm and i < (option->length - 2) / 8; i++) {
+        Seq left = ntohl(*(uint32_t*)(option->data + i*8));
+        Seq right = ntohl(*(uint32_t*)(option->data + i*8 + 4));
+        if(seq_lt(left, right) and seq_lt(cb.SND.UNA, right) and seq_leq(right, cb.SND.NXT))
+          scoreboard.insert(seq_lt(left, cb.SND.UNA) ? cb.SND.UNA : left, right);
+      }
+      opt += option->length;
+      break;
+    }
+
+    case Option::TFO: {
+      if(option->length < 2)
+        return bad_option(Option::TFO, "length < 2");
+      // the cookie is copied, all of it must be in the header
+      if(option->length > (uint8_t*)packet->data() - opt)
+        return bad_option(Option::TFO, "past the header");
+
+      // a cookie for the next time we connect [RFC 7413]
+      if(packet->isset(SYN) and packet->isset(ACK))
+        host_.fastopen_remember(remote_.address(), option->data, option->length - 2);
+      opt += option->length;
+      break;
+    }
+
     default:
-      return;
+      // skip unknown options
+      if(option->length < 2)
+        return;
+      opt += option->length;
+      break;
     }
   }
 }
@@ -806,6 +1574,33 @@ void Connection::add_option(TCP::Option::Kind kind, TCP::Packet_ptr packet) {
            packet->to_string().c_str(), ntohs(*(uint16_t*)(packet->options()+2)));
     break;
   }
+
+  case Option::WS: {
+    packet->add_option<Option::opt_ws>(cb.RCV.wind_shift);
+    break;
+  }
+
+  case Option::SACK_PERM: {
+    packet->add_option<Option::opt_sack_perm>();
+    break;
+  }
+
+  case Option::TS: {
+    packet->add_option<Option::opt_timestamp>(Clock::now(), ts.recent);
+    break;
+  }
+
+  case Option::SACK: {
+    Sack_block blocks[Option::opt_sack::max_blocks];
+    // 3 blocks left room for, with timestamps
+    const size_t max = std::min(Option::opt_sack::max_blocks,
+                                (40 - 4 - (size_t)packet->options_length()) / 8);
+    auto n = reassq.sack_blocks(blocks, max);
+    if(n)
+      packet->add_option<Option::opt_sack>(blocks, n);
+    break;
+  }
+
   default:
     break;
   }
@@ -95,6 +95,12 @@ bool Connection::State::check_seq(Connection& tcp, TCP::Packet_ptr in) {
   auto& tcb = tcp.tcb();
   bool acceptable = false;
   debug2("<Connection::State::check_seq> TCB: %s \n",tcb.to_string().c_str());
+  // PAWS [RFC 7323 p. 19]: an old duplicate, treat as unacceptable
+  if(tcp.paws_reject(in)) {
+    tcp.send_ack();
+    tcp.drop(in, "PAWS: TSval < TS.Recent");
+    return false;
+  }
   // #1
   if( in->seq() == tcb.RCV.NXT ) {
     acceptable = true;
@@ -123,11 +129,8 @@ bool Connection::State::check_seq(Connection& tcp, TCP::Packet_ptr in) {
     and return.
   */
   if(!acceptable) {
-    if(!in->isset(RST)) {
-      auto packet = tcp.outgoing_packet();
-      packet->set_seq(tcb.SND.NXT).set_ack(tcb.RCV.NXT).set_flag(ACK);
-      tcp.transmit(packet);
-    }
+    if(!in->isset(RST))
+      tcp.send_ack();
     std::stringstream ss;
     ss << "Unacceptable SEQ: "
        << "[Packet: SEQ: " << in->seq() << " LEN: " << in->data_length() << "] "
@@ -136,6 +139,16 @@ bool Connection::State::check_seq(Connection& tcp, TCP::Packet_ptr in) {
     tcp.drop(in, ss.str());
     return false;
   }
+  /*
+    A FIN can't be processed before the data in front of it has arrived.
+    Forget about it; it's not acknowledged, so it will be sent again.
+  */
+  if(in->isset(FIN) and seq_lt(tcb.RCV.NXT, in->seq())) {
+    in->clear_flag(FIN);
+    if(!in->has_data())
+      tcp.send_ack();
+  }
+  tcp.update_ts_recent(in);
   debug2("<Connection::State::check_seq> Acceptable SEQ: %u \n", in->seq());
   // is acceptable.
   return true;
@@ -315,24 +328,45 @@ void Connection::State::process_segment(Connection& tcp, TCP::Packet_ptr in) {
 
   auto& tcb = tcp.tcb();
   auto length = in->data_length();
-  // Receive could result in a user callback. This is used to avoid sending empty ACK reply.
+
+  /*
+    Segments with higher begining sequence numbers may be held for later processing.
+    Queue the part inside the window, and send an immediate duplicate ACK
+    so the sender learns about the gap [RFC 5681 p. 9].
+  */
+  if(seq_lt(tcb.RCV.NXT, in->seq())) {
+    auto end = in->end();
+    const auto wnd_end = tcb.RCV.NXT + tcb.RCV.WND;
+    if(seq_lt(wnd_end, end))
+      end = wnd_end;
+
+    debug("<TCP::Connection::State::process_segment> Out of order: SEQ: %u LEN: %u RCV.NXT: %u. Queued: %u\n",
+          in->seq(), length, tcb.RCV.NXT, tcp.reassq.size());
+    if(!tcp.reassq.insert(in, in->seq(), end))
+      tcp.drop(in, "Nothing new, or reassembly queue full");
+
+    tcp.send_ack();
+    return;
+  }
+
   debug("<TCP::Connection::State::process_segment> Received packet with DATA-LENGTH: %i. Add to receive buffer. \n", length);
-  tcb.RCV.NXT += length;
-  auto snd_nxt = tcb.SND.NXT;
-  if(tcp.read_request.buffer.capacity()) {
-    auto received = tcp.receive((uint8_t*)in->data(), in->data_length(), in->isset(PSH));
-    Ensures(received == length);
+  // This may fill a gap
+  const bool gap = !tcp.reassq.empty();
+  // If the segment straddles RCV.NXT, only the new part is processed
+  // Receive could result in a user callback, and any data sent carries the ACK.
+  if(seq_lt(tcb.RCV.NXT, in->end())) {
+    auto skip = tcb.RCV.NXT - in->seq();
+    tcp.receive_in_order(in, (uint8_t*)in->data() + skip, length - skip, in->isset(PSH));
   }
+  if(gap)
+    tcp.drain_reassembly_queue();
 
   // [RFC 5681]
   //tcb.SND.cwnd += std::min(length, tcp.SMSS());
-  debug2("<TCP::Connection::State::process_segment> Advanced RCV.NXT: %u. SND.NXT = %u \n", tcb.RCV.NXT, snd_nxt);
+  debug2("<TCP::Connection::State::process_segment> Advanced RCV.NXT: %u. SND.NXT = %u \n", tcb.RCV.NXT, tcb.SND.NXT);
 
-  if(tcb.SND.NXT == snd_nxt) {
-    auto packet = tcp.outgoing_packet();
-    packet->set_seq(tcb.SND.NXT).set_ack(tcb.RCV.NXT).set_flag(ACK);
-    tcp.transmit(packet);
-  }
+  // ACK right away when there was a gap [RFC 5681 p. 11], or the sender pushed
+  tcp.ack_data(length, gap or in->isset(PSH));
   //if(tcp.can_send())
   //  tcp.send_much();
   /*if(tcp.has_doable_job() and !tcp.is_queued()) {
@@ -411,8 +445,12 @@ void Connection::State::process_fin(Connection& tcp, TCP::Packet_ptr in) {
   packet->set_ack(tcb.RCV.NXT).set_flag(ACK);
   tcp.transmit(packet);
   // signal the user
-  if(!tcp.read_request.buffer.empty())
-    tcp.receive_disconnect();
+  if(tcp.cold_) {
+    if(!tcp.cold_->read_request.buffer.empty())
+      tcp.receive_disconnect();
+    if(tcp.cold_->rcv_payload.callback)
+      tcp.deliver_payload();
+  }
 }
 /////////////////////////////////////////////////////////////////////
 
@@ -482,49 +520,44 @@ void Connection::State::send_reset(Connection& tcp) {
 */
 /////////////////////////////////////////////////////////////////////
 
-void Connection::State::open(Connection&, bool) {
-  throw TCPException{"Connection already exists."};
+TCP::Error Connection::State::open(Connection&, bool) {
+  return Error::EXISTS;
 }
 
-void Connection::Closed::open(Connection& tcp, bool active) {
+TCP::Error Connection::Closed::open(Connection& tcp, bool active) {
   if(active) {
     // There is a remote host
     if(!tcp.remote().is_empty()) {
       auto& tcb = tcp.tcb();
-      tcb.init();
-      auto packet = tcp.outgoing_packet();
-      packet->set_seq(tcb.ISS).set_flag(SYN);
-
-      /*
-        Add MSS option.
-      */
-      tcp.add_option(Option::MSS, packet);
-
+      tcb.init(tcp.generate_iss());
+      // offer window scaling, turned off again if the remote doesn't
+      tcb.RCV.wind_shift = TCP::default_window_shift;
       tcb.SND.UNA = tcb.ISS;
       tcb.SND.NXT = tcb.ISS+1;
-      tcp.transmit(packet);
+      tcp.send_syn(true);
       tcp.set_state(SynSent::instance());
     } else {
-      throw TCPException{"No remote host set."};
+      return Error::NO_REMOTE;
     }
   } else {
     tcp.set_state(Connection::Listen::instance());
   }
+  return Error::NONE;
 }
 
-void Connection::Listen::open(Connection& tcp, bool) {
+TCP::Error Connection::Listen::open(Connection& tcp, bool) {
   if(!tcp.remote().is_empty()) {
     auto& tcb = tcp.tcb();
-    tcb.init();
+    tcb.init(tcp.generate_iss());
     auto packet = tcp.outgoing_packet();
     packet->set_seq(tcb.ISS).set_flag(SYN);
     tcb.SND.UNA = tcb.ISS;
     tcb.SND.NXT = tcb.ISS+1;
     tcp.transmit(packet);
     tcp.set_state(SynSent::instance());
-  } else {
-    throw TCPException{"No remote host set."};
+    return Error::NONE;
   }
+  return Error::NO_REMOTE;
 }
 
 
@@ -537,15 +570,15 @@ void Connection::Listen::open(Connection& tcp, bool) {
 */
 /////////////////////////////////////////////////////////////////////
 
-size_t Connection::State::send(Connection&, WriteBuffer&) {
-  throw TCPException{"Connection closing."};
+TCP::Expected<size_t> Connection::State::send(Connection&, WriteBuffer&) {
+  return Error::CLOSING;
 }
 
-size_t Connection::Closed::send(Connection&, WriteBuffer&) {
-  throw TCPException{"Connection does not exist."};
+TCP::Expected<size_t> Connection::Closed::send(Connection&, WriteBuffer&) {
+  return Error::NOT_OPEN;
 }
 
-size_t Connection::Listen::send(Connection&, WriteBuffer&) {
+TCP::Expected<size_t> Connection::Listen::send(Connection&, WriteBuffer&) {
   // TODO: Skip this?
   /*
     If the foreign socket is specified, then change the connection
@@ -560,12 +593,11 @@ size_t Connection::Listen::send(Connection&, WriteBuffer&) {
     socket unspecified".
   */
   //if(tcp.remote().is_empty())
-  //  throw TCPException{"Foreign socket unspecified."};
-  throw TCPException{"Cannot send on listening connection."};
-  return 0;
+  //  return Error::NO_REMOTE;
+  return Error::LISTENING;
 }
 
-size_t Connection::SynSent::send(Connection&, WriteBuffer&) {
+TCP::Expected<size_t> Connection::SynSent::send(Connection&, WriteBuffer&) {
   /*
     Queue the data for transmission after entering ESTABLISHED state.
     If no space to queue, respond with "error:  insufficient
@@ -575,7 +607,10 @@ size_t Connection::SynSent::send(Connection&, WriteBuffer&) {
   return 0; // nothing written, indicates queue
 }
 
-size_t Connection::SynReceived::send(Connection&, WriteBuffer&) {
+TCP::Expected<size_t> Connection::SynReceived::send(Connection& tcp, WriteBuffer& buffer) {
+  // Fast Open: the SYN's data was taken, it can be answered right away [RFC 7413]
+  if(tcp.syn_data_accepted() and !tcp.writeq.remaining_requests())
+    return tcp.send(buffer);
   /*
     Queue the data for transmission after entering ESTABLISHED state.
     If no space to queue, respond with "error:  insufficient
@@ -585,7 +620,7 @@ size_t Connection::SynReceived::send(Connection&, WriteBuffer&) {
   return 0; // nothing written, indicates queue
 }
 
-size_t Connection::Established::send(Connection& tcp, WriteBuffer& buffer) {
+TCP::Expected<size_t> Connection::Established::send(Connection& tcp, WriteBuffer& buffer) {
   // if nothing in queue, try to write directly
   if(!tcp.writeq.remaining_requests())
     return tcp.send(buffer);
@@ -593,7 +628,7 @@ size_t Connection::Established::send(Connection& tcp, WriteBuffer& buffer) {
   return 0;
 }
 
-size_t Connection::CloseWait::send(Connection& tcp, WriteBuffer& buffer) {
+TCP::Expected<size_t> Connection::CloseWait::send(Connection& tcp, WriteBuffer& buffer) {
   // if nothing in queue, try to write directly
   if(!tcp.writeq.remaining_requests())
     return tcp.send(buffer);
@@ -610,24 +645,33 @@ size_t Connection::CloseWait::send(Connection& tcp, WriteBuffer& buffer) {
 */
 /////////////////////////////////////////////////////////////////////
 
-void Connection::State::receive(Connection&, ReadBuffer&) {
-  throw TCPException{"Connection closing."};
+TCP::Error Connection::State::receive(Connection&, ReadBuffer&) {
+  return Error::CLOSING;
+}
+
+TCP::Error Connection::SynReceived::receive(Connection& tcp, ReadBuffer& buffer) {
+  tcp.receive(buffer);
+  return Error::NONE;
 }
 
-void Connection::Established::receive(Connection& tcp, ReadBuffer& buffer) {
+TCP::Error Connection::Established::receive(Connection& tcp, ReadBuffer& buffer) {
   tcp.receive(buffer);
+  return Error::NONE;
 }
 
-void Connection::FinWait1::receive(Connection& tcp, ReadBuffer& buffer) {
+TCP::Error Connection::FinWait1::receive(Connection& tcp, ReadBuffer& buffer) {
   tcp.receive(buffer);
+  return Error::NONE;
 }
 
-void Connection::FinWait2::receive(Connection& tcp, ReadBuffer& buffer) {
+TCP::Error Connection::FinWait2::receive(Connection& tcp, ReadBuffer& buffer) {
   tcp.receive(buffer);
+  return Error::NONE;
 }
 
-void Connection::CloseWait::receive(Connection& tcp, ReadBuffer& buffer) {
+TCP::Error Connection::CloseWait::receive(Connection& tcp, ReadBuffer& buffer) {
   tcp.receive(buffer);
+  return Error::NONE;
 }
 
 /////////////////////////////////////////////////////////////////////
@@ -639,29 +683,31 @@ void Connection::CloseWait::receive(Connection& tcp, ReadBuffer& buffer) {
 */
 /////////////////////////////////////////////////////////////////////
 
-void Connection::State::close(Connection&) {
-  throw TCPException{"Connection closing."};
+TCP::Error Connection::State::close(Connection&) {
+  return Error::CLOSING;
 }
 
-void Connection::Listen::close(Connection& tcp) {
+TCP::Error Connection::Listen::close(Connection& tcp) {
   /*
     Any outstanding RECEIVEs are returned with "error:  closing"
     responses.  Delete TCB, enter CLOSED state, and return.
   */
   // tcp.signal_disconnect("Closing")
   tcp.set_state(Closed::instance());
+  return Error::NONE;
 }
 
-void Connection::SynSent::close(Connection& tcp) {
+TCP::Error Connection::SynSent::close(Connection& tcp) {
   /*
     Delete the TCB and return "error:  closing" responses to any
     queued SENDs, or RECEIVEs.
   */
   // tcp.signal_disconnect("Closing")
   tcp.set_state(Closed::instance());
+  return Error::NONE;
 }
 
-void Connection::SynReceived::close(Connection& tcp) {
+TCP::Error Connection::SynReceived::close(Connection& tcp) {
   /*
     If no SENDs have been issued and there is no pending data to send,
     then form a FIN segment and send it, and enter FIN-WAIT-1 state;
@@ -673,35 +719,39 @@ void Connection::SynReceived::close(Connection& tcp) {
   packet->set_seq(tcb.SND.NXT++).set_ack(tcb.RCV.NXT).set_flags(ACK | FIN);
   tcp.transmit(packet);
   tcp.set_state(Connection::FinWait1::instance());
+  return Error::NONE;
 }
 
-void Connection::Established::close(Connection& tcp) {
+TCP::Error Connection::Established::close(Connection& tcp) {
   auto& tcb = tcp.tcb();
   auto packet = tcp.outgoing_packet();
   packet->set_seq(tcb.SND.NXT++).set_ack(tcb.RCV.NXT).set_flags(ACK | FIN);
   tcp.transmit(packet);
   tcp.set_state(Connection::FinWait1::instance());
+  return Error::NONE;
 }
 
-void Connection::FinWait1::close(Connection&) {
+TCP::Error Connection::FinWait1::close(Connection&) {
   /*
     Strictly speaking, this is an error and should receive a "error:
     connection closing" response.  An "ok" response would be
     acceptable, too, as long as a second FIN is not emitted (the first
     FIN may be retransmitted though).
   */
+  return Error::NONE;
 }
 
-void Connection::FinWait2::close(Connection&) {
+TCP::Error Connection::FinWait2::close(Connection&) {
   /*
     Strictly speaking, this is an error and should receive a "error:
     connection closing" response.  An "ok" response would be
     acceptable, too, as long as a second FIN is not emitted (the first
     FIN may be retransmitted though).
   */
+  return Error::NONE;
 }
 
-void Connection::CloseWait::close(Connection& tcp) {
+TCP::Error Connection::CloseWait::close(Connection& tcp) {
   /*
     Queue this request until all preceding SENDs have been
     segmentized; then send a FIN segment, enter CLOSING state.
@@ -713,6 +763,7 @@ void Connection::CloseWait::close(Connection& tcp) {
   //tcp.set_state(Connection::Closing::instance());
   // Correction: [RFC 1122 p. 93]
   tcp.set_state(Connection::LastAck::instance());
+  return Error::NONE;
 }
 
 /////////////////////////////////////////////////////////////////////
@@ -791,20 +842,30 @@ State::Result Connection::Listen::handle(Connection& tcp, TCP::Packet_ptr in) {
     auto& tcb = tcp.tcb();
     tcb.RCV.NXT   = in->seq()+1;
     tcb.IRS     = in->seq();
-    tcb.init();
+    tcb.init(tcp.generate_iss());
     tcb.SND.NXT   = tcb.ISS+1;
     tcb.SND.UNA   = tcb.ISS;
     debug("<TCP::Connection::Listen::handle> Received SYN Packet: %s TCB Updated:\n %s \n",
           in->to_string().c_str(), tcp.tcb().to_string().c_str());
 
+    // scale our window only if the remote scales its own [RFC 7323 p. 9]
+    if(tcp.wscale_perm)
+      tcb.RCV.wind_shift = TCP::default_window_shift;
+
     auto packet = tcp.outgoing_packet();
     packet->set_seq(tcb.ISS).set_ack(tcb.RCV.NXT).set_flags(SYN | ACK);
+    packet->set_win(tcp.advertised_window(true));
 
     /*
       Add MSS option.
       TODO: Send even if we havent received MSS option?
     */
     tcp.add_option(Option::MSS, packet);
+    if(tcp.wscale_perm)
+      tcp.add_option(Option::WS, packet);
+    // only if the remote asked for it
+    if(tcp.sack_perm)
+      tcp.add_option(Option::SACK_PERM, packet);
 
     tcp.transmit(packet);
     tcp.set_state(SynReceived::instance());
@@ -835,8 +896,7 @@ State::Result Connection::SynSent::handle(Connection& tcp, TCP::Packet_ptr in) {
       }
       // If SND.UNA =< SEG.ACK =< SND.NXT then the ACK is acceptable.
     } else {
-      if(tcp.rttm.active)
-        tcp.rttm.stop(true);
+      tcp.rtt_sample();
     }
   }
 
@@ -896,6 +956,14 @@ State::Result Connection::SynSent::handle(Connection& tcp, TCP::Packet_ptr in) {
     tcb.IRS       = in->seq();
     tcb.SND.UNA   = in->ack();
 
+    // the remote didn't scale, so neither do we [RFC 7323 p. 9]
+    if(!tcp.wscale_perm) {
+      tcb.RCV.wind_shift = 0;
+      tcb.SND.wind_shift = 0;
+    }
+    // an ECN-setup SYN-ACK [RFC 3168]
+    tcp.ecn_ok = tcp.host_.ecn() and in->isset(ACK) and in->isset(ECE) and !in->isset(CWR);
+
     //tcp.rtx_ack(in->ack());
 
     // (our SYN has been ACKed)
@@ -907,6 +975,13 @@ State::Result Connection::SynSent::handle(Connection& tcp, TCP::Packet_ptr in) {
       tcb.SND.WL2 = in->ack();
       // end of correction
 
+      // the SYN carried data, what wasn't acked goes again [RFC 7413]
+      if(tcb.SND.NXT != tcb.ISS + 1) {
+        tcp.fastopen_acked();
+        if(tcb.SND.UNA != tcb.SND.NXT)
+          tcp.retransmit();
+      }
+
       TCP::Seq snd_nxt = tcb.SND.NXT;
       tcp.signal_connect(); // NOTE: User callback
 
@@ -937,6 +1012,7 @@ State::Result Connection::SynSent::handle(Connection& tcp, TCP::Packet_ptr in) {
     else {
       auto packet = tcp.outgoing_packet();
       packet->set_seq(tcb.ISS).set_ack(tcb.RCV.NXT).set_flags(SYN | ACK);
+      packet->set_win(tcp.advertised_window(true));
       tcp.transmit(packet);
       tcp.set_state(Connection::SynReceived::instance());
       if(in->has_data()) {
@@ -958,6 +1034,12 @@ State::Result Connection::SynSent::handle(Connection& tcp, TCP::Packet_ptr in) {
 
 
 State::Result Connection::SynReceived::handle(Connection& tcp, TCP::Packet_ptr in) {
+  // the SYN again, our SYN-ACK got lost
+  if(in->isset(SYN) and !in->isset(ACK) and in->seq() == tcp.tcb().IRS) {
+    tcp.send_synack();
+    tcp.drop(in, "SYN-RCV: SYN retransmitted");
+    return OK;
+  }
   // 1. check sequence
   if(! check_seq(tcp, in) ) {
     return OK;
@@ -1000,22 +1082,28 @@ State::Result Connection::SynReceived::handle(Connection& tcp, TCP::Packet_ptr i
     */
     if(tcb.SND.UNA <= in->ack() and in->ack() <= tcb.SND.NXT) {
       debug("<TCP::Connection::SynReceived::handle> SND.UNA =< SEG.ACK =< SND.NXT, continue in ESTABLISHED. \n");
-      if(tcp.rttm.active)
-        tcp.rttm.stop(true);
+      // a backdated TSval would make a long first sample
+      if(!tcp.syn_cookie)
+        tcp.rtt_sample();
       tcp.set_state(Connection::Established::instance());
+      // handed over already, with the data in the SYN
+      const bool fastopen = tcp.syn_data_accepted();
 
       // Taken from acknowledge (without congestion control)
       tcb.SND.UNA = in->ack();
-      if(tcp.rttm.active)
-        tcp.rttm.stop();
       //tcp.rtx_ack(in->ack());
+      if(fastopen)
+        tcp.fastopen_acked();
 
       // 7. proccess the segment text
       if(in->has_data()) {
         process_segment(tcp, in);
       }
 
-      tcp.signal_connect(); // NOTE: User callback
+      if(fastopen)
+        tcp.writeq_push();
+      else
+        tcp.signal_established(); // NOTE: User callback
 
       // 8. check FIN bit
       if(in->isset(FIN)) {
@@ -56,8 +56,8 @@ VirtioNet::VirtioNet(hw::PCI_Device& d)
     | (1 << VIRTIO_NET_F_MAC)
     | (1 << VIRTIO_NET_F_STATUS);
   //| (1 << VIRTIO_NET_F_MRG_RXBUF); //Merge RX Buffers (Everything i 1 buffer)
-  uint32_t wanted_features = needed_features; /*;
-                                                | (1 << VIRTIO_NET_F_CSUM)
+  uint32_t wanted_features = needed_features
+    | (1 << VIRTIO_NET_F_CSUM); /*;
                                                 | (1 << VIRTIO_F_ANY_LAYOUT)
                                                 | (1 << VIRTIO_NET_F_CTRL_VQ)
                                                 | (1 << VIRTIO_NET_F_GUEST_ANNOUNCE)
@@ -72,8 +72,8 @@ VirtioNet::VirtioNet(hw::PCI_Device& d)
   CHECK ((features() & wanted_features) == wanted_features,
          "Negotiated wanted features");
 
-  CHECK(features() & (1 << VIRTIO_NET_F_CSUM),
-        "Device handles packets w. partial checksum");
+  csum_offload_ = features() & (1 << VIRTIO_NET_F_CSUM);
+  CHECK(csum_offload_, "Device handles packets w. partial checksum");
 
   CHECK(features() & (1 << VIRTIO_NET_F_GUEST_CSUM),
         "Guest handles packets w. partial checksum");
@@ -270,6 +270,10 @@ void VirtioNet::service_queues(){
   if (dequeued_rx)
     rx_q.kick();
 
+  // Let the stack deliver whatever it batched up
+  if (dequeued_rx)
+    receive_done_event_();
+
 
   rx_q.enable_interrupts();
   tx_q.enable_interrupts();
@@ -367,8 +371,20 @@ void VirtioNet::transmit(net::Packet_ptr pckt){
 void VirtioNet::enqueue(net::Packet_ptr pckt){
 
 
+  auto* hdr = const_cast<virtio_net_hdr*>(&empty_header);
+
+  // The stack left the checksum for us. Use the headroom in front of the
+  // packet (bufstore's device offset) for a header of its own.
+  if (pckt->checksum_offload()) {
+    hdr = reinterpret_cast<virtio_net_hdr*>(pckt->buffer() - sizeof(virtio_net_hdr));
+    *hdr = empty_header;
+    hdr->flags       = VIRTIO_NET_HDR_F_NEEDS_CSUM;
+    hdr->csum_start  = pckt->csum_start();
+    hdr->csum_offset = pckt->csum_offset();
+  }
+
   // This setup requires all tokens to be pre-chained like in SanOS
-  Token token1 {{(uint8_t*) &empty_header, sizeof(virtio_net_hdr)},
+  Token token1 {{(uint8_t*) hdr, sizeof(virtio_net_hdr)},
       Token::OUT };
 
   Token token2 { {pckt->buffer(), (Token::size_type) pckt->size() }, Token::OUT };
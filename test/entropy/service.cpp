@@ -0,0 +1,57 @@
+// This file is a part of the IncludeOS unikernel - www.includeos.org
+//
+// Copyright 2015 Oslo and Akershus University College of Applied Sciences
+// and Alfred Bratterud
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <os>
+#include <kernel/entropy.hpp>
+#include <info>
+#include <cstring>
+
+constexpr size_t ROUNDS {1000000};
+
+void Service::start()
+{
+  INFO("Entropy", "Keyed from %s", Entropy::hardware_seeded() ? "RDRAND" : "the TSC");
+
+  // Every bit should be set about half the time
+  uint32_t ones[32] {};
+  for (size_t i = 0; i < ROUNDS; i++) {
+    const uint32_t r = Entropy::random32();
+    for (int b = 0; b < 32; b++)
+      ones[b] += (r >> b) & 1;
+  }
+  auto t1 = OS::cycles_since_boot();
+  for (size_t i = 0; i < ROUNDS; i++)
+    (void) Entropy::random32();
+  auto t2 = OS::cycles_since_boot();
+  for (size_t i = 0; i < ROUNDS; i++)
+    (void) rand();
+  auto t3 = OS::cycles_since_boot();
+
+  INFO2("random32: %llu cycles", (t2 - t1) / ROUNDS);
+  INFO2("rand():   %llu cycles", (t3 - t2) / ROUNDS);
+
+  for (int b = 0; b < 32; b++)
+    CHECKSERT(ones[b] > ROUNDS * 49 / 100 and ones[b] < ROUNDS * 51 / 100,
+              "Bit %d is set %u times in %u", b, ones[b], ROUNDS);
+
+  uint8_t a[32], b[32];
+  Entropy::fill(a, sizeof(a));
+  Entropy::fill(b, sizeof(b));
+  CHECKSERT(memcmp(a, b, sizeof(a)) != 0, "Two fills differ");
+
+  INFO("Entropy", "SUCCESS");
+}
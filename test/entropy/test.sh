@@ -0,0 +1,5 @@
+#!/bin/bash
+source ../test_base
+
+make
+start test_entropy.img "Kernel entropy service"
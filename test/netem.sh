@@ -0,0 +1,22 @@
+#!/bin/bash
+# Usage: ./netem.sh up "<netem parameters>" | ./netem.sh down
+#
+# Applies netem to traffic leaving the guest, i.e. the data segments,
+# by redirecting the ingress of every tap on the bridge through ifb0.
+BRIDGE=${BRIDGE-include0}
+TAPS=$(ls /sys/class/net/$BRIDGE/brif 2>/dev/null)
+
+if [ "$1" == "up" ]; then
+  sudo modprobe ifb numifbs=1
+  sudo ip link set dev ifb0 up
+  sudo tc qdisc add dev ifb0 root netem $2
+  for tap in $TAPS; do
+    sudo tc qdisc add dev $tap handle ffff: ingress
+    sudo tc filter add dev $tap parent ffff: u32 match u32 0 0 action mirred egress redirect dev ifb0
+  done
+else
+  for tap in $TAPS; do
+    sudo tc qdisc del dev $tap handle ffff: ingress 2>/dev/null
+  done
+  sudo tc qdisc del dev ifb0 root 2>/dev/null
+fi
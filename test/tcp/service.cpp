@@ -63,6 +63,8 @@ void FINISH_TEST() {
       INFO("TEST", "Verify release of resources");
       CHECK(inet->tcp().activeConnections() == 0, 
         "tcp.activeConnections() == 0");
+      CHECK(inet->tcp().time_wait_count() == 0,
+        "tcp.time_wait_count() == 0");
       CHECK(inet->buffers_available() == buffers_available, 
         "inet->buffers_available() == buffers_available");
       printf("# TEST SUCCESS #\n");
@@ -0,0 +1,82 @@
+// This file is a part of the IncludeOS unikernel - www.includeos.org
+//
+// Copyright 2015 Oslo and Akershus University College of Applied Sciences
+// and Alfred Bratterud
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef TEST_TCP_BULK_HPP
+#define TEST_TCP_BULK_HPP
+
+#include <net/tcp.hpp>
+#include <info>
+#include <cstring>
+#include <functional>
+#include <memory>
+
+/**
+ *  The sending side of the TCP bulk transfer benchmarks
+ *
+ *  Writes TRANSFER bytes on a connection, CHUNK at a time, prints the
+ *  goodput and closes it. The host end is in tcp_bulk.py.
+ */
+namespace bulk {
+
+  using namespace net;
+
+  constexpr size_t TRANSFER {16 * 1024 * 1024};
+  constexpr size_t CHUNK    {64 * 1024};
+
+  struct Transfer {
+    TCP::Connection_ptr conn;
+    const char* name;
+    std::function<void()> done;
+    size_t sent;
+    TCP::Clock::tick_t start;
+  };
+
+  inline TCP::buffer_t chunk()
+  {
+    static TCP::buffer_t buf = [] {
+      TCP::buffer_t b(new uint8_t[CHUNK], std::default_delete<uint8_t[]>());
+      memset(b.get(), 'x', CHUNK);
+      return b;
+    }();
+    return buf;
+  }
+
+  inline void send_chunk(std::shared_ptr<Transfer> t)
+  {
+    if (t->sent == TRANSFER) {
+      auto ms = std::max(TCP::Clock::now() - t->start, (TCP::Clock::tick_t) 1);
+      INFO2("%-8s %u KB in %u ms, %u KB/s", t->name,
+            TRANSFER / 1024, ms, TRANSFER / ms * 1000 / 1024);
+      t->conn->close();
+      t->done();
+      return;
+    }
+    t->conn->write(chunk(), CHUNK, [t](size_t n) {
+        t->sent += n;
+        send_chunk(t);
+      });
+  }
+
+  /** Send TRANSFER bytes on @conn, reported as @name, then call @done */
+  inline void send(TCP::Connection_ptr conn, const char* name, std::function<void()> done)
+  {
+    send_chunk(std::make_shared<Transfer>(Transfer{conn, name, done, 0, TCP::Clock::now()}));
+  }
+
+} //< namespace bulk
+
+#endif //< TEST_TCP_BULK_HPP
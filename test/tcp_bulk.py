@@ -0,0 +1,31 @@
+# The host side of the TCP bulk transfer benchmarks, see tcp_bulk.hpp
+
+import socket
+import subprocess
+import time
+
+NETEM_SH = "../netem.sh"
+
+def receive(guest, port):
+    """Read from the guest until it closes. Returns (bytes, seconds)"""
+    sock = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+    sock.connect((guest, port))
+    received = 0
+    start = time.time()
+    while True:
+        data = sock.recv(65536)
+        if not data:
+            break
+        received += len(data)
+    elapsed = time.time() - start
+    sock.close()
+    return received, elapsed
+
+def with_netem(netem, run):
+    """Call run() with netem applied to everything leaving the guest"""
+    subprocess.call([NETEM_SH, "up", netem])
+    try:
+        print "netem:", netem
+        run()
+    finally:
+        subprocess.call([NETEM_SH, "down"])
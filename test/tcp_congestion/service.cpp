@@ -0,0 +1,58 @@
+// This file is a part of the IncludeOS unikernel - www.includeos.org
+//
+// Copyright 2015 Oslo and Akershus University College of Applied Sciences
+// and Alfred Bratterud
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <os>
+#include <net/inet4>
+#include <tcp_bulk.hpp>
+
+using namespace net;
+using Connection_ptr = TCP::Connection_ptr;
+
+std::unique_ptr<Inet4<VirtioNet>> inet;
+
+/* One bulk transfer per algorithm, on its own port */
+const std::pair<TCP::Port, TCP::Congestion> SERVERS[] {
+  {8001, TCP::NEWRENO},
+  {8002, TCP::CUBIC},
+  {8003, TCP::BBR}
+};
+
+int finished {0};
+
+void Service::start()
+{
+  hw::Nic<VirtioNet>& eth0 = hw::Dev::eth<0,VirtioNet>();
+  inet = std::make_unique<Inet4<VirtioNet>>(eth0);
+  inet->network_config( {  10,  0,  0, 42 },  // IP
+                        {  255,255,255, 0 },  // Netmask
+                        {  10,  0,  0,  1 },  // Gateway
+                        {   8,  8,  8,  8 } );// DNS
+
+  auto& tcp = inet->tcp();
+  for (auto& server : SERVERS) {
+    auto algorithm = server.second;
+    tcp.bind(server.first).onConnect([algorithm](Connection_ptr conn) {
+        conn->set_congestion_control(algorithm);
+        bulk::send(conn, conn->congestion_control(), [] {
+            if (++finished == 3)
+              INFO("Congestion", "SUCCESS");
+          });
+      });
+  }
+
+  INFO("Congestion", "Benchmark ready, %u KB per algorithm", bulk::TRANSFER / 1024);
+}
@@ -0,0 +1,34 @@
+#!/usr/bin/python
+
+import os
+import re
+import subprocess
+import sys
+sys.path.insert(0,"..")
+
+import vmrunner
+import tcp_bulk
+
+# Usage: python test.py $GUEST_IP
+GUEST = '10.0.0.42' if (len(sys.argv) < 2) else sys.argv[1]
+NETEM = os.environ.get("NETEM", "delay 20ms 2ms loss 0.5% rate 50mbit limit 200")
+
+def transfer(name, port):
+    # Ping alongside the transfer, to see the queueing delay it causes
+    ping = subprocess.Popen(["ping", "-i", "0.2", GUEST], stdout=subprocess.PIPE)
+    received, elapsed = tcp_bulk.receive(GUEST, port)
+    ping.terminate()
+    rtts = [float(x) for x in re.findall(r"time=([\d.]+)", ping.communicate()[0])]
+    rtt = sum(rtts) / len(rtts) if rtts else 0
+    print "%-8s %8.1f KB/s   avg RTT under load %6.1f ms" % (name, received / elapsed / 1024, rtt)
+
+def benchmark():
+    def run():
+        transfer("NewReno", 8001)
+        transfer("CUBIC", 8002)
+        transfer("BBR", 8003)
+    tcp_bulk.with_netem(NETEM, run)
+
+vm = vmrunner.vms[0]
+vm.on_output("Benchmark ready", benchmark)
+vm.boot(300)
@@ -0,0 +1,4 @@
+#!/bin/bash
+# NETEM overrides the impairment, e.g. NETEM="delay 50ms loss 1%" ./test.sh
+make
+python test.py
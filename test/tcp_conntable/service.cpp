@@ -0,0 +1,107 @@
+// This file is a part of the IncludeOS unikernel - www.includeos.org
+//
+// Copyright 2015 Oslo and Akershus University College of Applied Sciences
+// and Alfred Bratterud
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <os>
+#include <net/tcp.hpp>
+#include <map>
+#include <vector>
+#include <info>
+
+using namespace net;
+
+using Tuple = TCP::Connection::Tuple;
+
+constexpr size_t   CONNECTIONS {100000};
+constexpr size_t   LOOKUPS     {1000000};
+constexpr TCP::Port LOCAL_PORT {80};
+
+void Service::start()
+{
+  INFO("Conntable", "Benchmarking with %u connections", CONNECTIONS);
+
+  // Remote peers, as a busy server would see them
+  std::vector<Tuple> tuples;
+  tuples.reserve(CONNECTIONS);
+  for (size_t i = 0; i < CONNECTIONS; i++) {
+    TCP::Address addr;
+    addr.whole = 0x0a000000 | (rand() & 0xffffff);
+    tuples.emplace_back(LOCAL_PORT, TCP::Socket{addr, (TCP::Port) (1024 + rand() % 64000)});
+  }
+
+  Connection_table<Tuple, TCP::Connection_ptr> table;
+  std::map<Tuple, TCP::Connection_ptr> map;
+
+  // Open
+  uint64_t worst_insert = 0;
+  auto t0 = OS::cycles_since_boot();
+  for (auto& tuple : tuples) {
+    auto start = OS::cycles_since_boot();
+    table.emplace(tuple, nullptr);
+    auto cycles = OS::cycles_since_boot() - start;
+    if (cycles > worst_insert) worst_insert = cycles;
+  }
+  auto t1 = OS::cycles_since_boot();
+  for (auto& tuple : tuples)
+    map.emplace(tuple, nullptr);
+  auto t2 = OS::cycles_since_boot();
+
+  INFO2("Insert:  table %llu cycles/conn (worst %llu), map %llu cycles/conn",
+        (t1 - t0) / CONNECTIONS, worst_insert, (t2 - t1) / CONNECTIONS);
+
+  CHECKSERT(table.size() == map.size(), "Table holds %u connections", table.size());
+
+  // Segments arriving for random connections
+  std::vector<uint32_t> order(LOOKUPS);
+  for (auto& i : order)
+    i = rand() % tuples.size();
+
+  size_t found = 0;
+  t0 = OS::cycles_since_boot();
+  for (auto i : order)
+    found += table.find(tuples[i]) != nullptr;
+  t1 = OS::cycles_since_boot();
+  for (auto i : order)
+    found += map.find(tuples[i]) != map.end();
+  t2 = OS::cycles_since_boot();
+
+  CHECKSERT(found == 2 * LOOKUPS, "All lookups hit");
+  INFO2("Lookup:  table %llu cycles/segment, map %llu cycles/segment",
+        (t1 - t0) / LOOKUPS, (t2 - t1) / LOOKUPS);
+
+  // Misses, i.e. SYNs for new connections
+  found = 0;
+  t0 = OS::cycles_since_boot();
+  for (size_t i = 0; i < LOOKUPS; i++) {
+    Tuple miss {LOCAL_PORT + 1, tuples[order[i]].second};
+    found += table.find(miss) != nullptr;
+  }
+  t1 = OS::cycles_since_boot();
+
+  CHECKSERT(found == 0, "No false hits");
+  INFO2("Miss:    table %llu cycles/segment", (t1 - t0) / LOOKUPS);
+
+  // Close
+  t0 = OS::cycles_since_boot();
+  for (auto& tuple : tuples)
+    table.erase(tuple);
+  t1 = OS::cycles_since_boot();
+
+  CHECKSERT(table.size() == 0, "All connections closed");
+  INFO2("Close:   table %llu cycles/conn", (t1 - t0) / CONNECTIONS);
+
+  INFO("Conntable", "SUCCESS");
+}
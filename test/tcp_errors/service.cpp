@@ -0,0 +1,95 @@
+// This file is a part of the IncludeOS unikernel - www.includeos.org
+//
+// Copyright 2015 Oslo and Akershus University College of Applied Sciences
+// and Alfred Bratterud
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <os>
+#include <net/inet4>
+#include <net/tcp.hpp>
+#include <info>
+
+using namespace net;
+
+constexpr size_t    ROUNDS {100000};
+constexpr TCP::Port LOCAL_PORT {80};
+
+std::unique_ptr<Inet4<VirtioNet>> inet;
+
+static size_t failed {0};
+
+template <typename Fn>
+static uint64_t cycles_per_op(Fn fn)
+{
+  auto t0 = OS::cycles_since_boot();
+  for (size_t i = 0; i < ROUNDS; i++)
+    fn();
+  return (OS::cycles_since_boot() - t0) / ROUNDS;
+}
+
+void Service::start()
+{
+  hw::Nic<VirtioNet>& eth0 = hw::Dev::eth<0,VirtioNet>();
+  inet = std::make_unique<Inet4<VirtioNet>>(eth0);
+  inet->network_config( {  10,  0,  0, 42 },  // IP
+                        {  255,255,255, 0 },  // Netmask
+                        {  10,  0,  0,  1 },  // Gateway
+                        {   8,  8,  8,  8 } );// DNS
+  auto& tcp = inet->tcp();
+
+  // never opened, and without a remote: every call on it fails
+  auto conn = std::make_shared<TCP::Connection>(tcp, LOCAL_PORT + 1);
+  conn->onError([](TCP::Connection_ptr, TCP::TCPException) { failed++; });
+
+  TCP::buffer_t buf {new uint8_t[1024], std::default_delete<uint8_t[]>()};
+
+  // How it was done before, for reference
+  auto unwind = cycles_per_op([] {
+      try {
+        throw TCP::TCPException{"Connection does not exist."};
+      }
+      catch (TCP::TCPException) {
+        failed++;
+      }
+    });
+  INFO("Errors", "throw/catch: %llu cycles", unwind);
+
+  auto write = cycles_per_op([&] {
+      conn->write(buf, 1024, [](size_t n) { if (!n) failed++; });
+    });
+  INFO2("write:       %llu cycles", write);
+
+  auto read = cycles_per_op([&] {
+      conn->read(buf, 1024, [](TCP::buffer_t, size_t) { failed++; });
+    });
+  INFO2("read:        %llu cycles", read);
+
+  auto open = cycles_per_op([&] { conn->open(true); });
+  INFO2("open:        %llu cycles", open);
+
+  auto close = cycles_per_op([&] { conn->close(); });
+  INFO2("close:       %llu cycles", close);
+
+  tcp.bind(LOCAL_PORT);
+  auto bind = cycles_per_op([&] {
+      if (!tcp.try_bind(LOCAL_PORT))
+        failed++;
+    });
+  INFO2("try_bind:    %llu cycles", bind);
+
+  CHECKSERT(failed == 6 * ROUNDS, "Every call failed, and said so");
+  CHECKSERT(write < unwind and bind < unwind, "Failing is cheaper than unwinding");
+
+  INFO("Errors", "SUCCESS");
+}
@@ -0,0 +1,5 @@
+#!/bin/bash
+source ../test_base
+
+make
+start test_tcp_errors.img "TCP error path benchmark"
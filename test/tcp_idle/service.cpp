@@ -0,0 +1,122 @@
+// This file is a part of the IncludeOS unikernel - www.includeos.org
+//
+// Copyright 2015 Oslo and Akershus University College of Applied Sciences
+// and Alfred Bratterud
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <os>
+#include <net/inet4>
+#include <net/tcp.hpp>
+#include <malloc.h>
+#include <info>
+
+using namespace net;
+
+constexpr size_t    CONNECTIONS {1000000};
+// measured over the last ones, when the connection table has its final size
+constexpr size_t    MEASURED {1 << 16};
+constexpr TCP::Port LOCAL_PORT {80};
+constexpr TCP::Seq  PEER_ISS {1000};
+
+std::unique_ptr<Inet4<VirtioNet>> inet;
+
+// The peer's answer to the SYN-ACK just sent, fed back once out of the stack
+TCP::Packet_ptr reply;
+
+size_t established = 0;
+
+static size_t heap_used()
+{ return mallinfo().uordblks; }
+
+static TCP::Socket peer(size_t i) {
+  TCP::Address addr;
+  addr.whole = 0x0a000000 | (i >> 16);
+  return {addr, (TCP::Port) i};
+}
+
+static TCP::Packet_ptr segment(TCP::Socket from, TCP::Seq seq, TCP::Seq ack, uint16_t flags) {
+  auto packet = std::static_pointer_cast<TCP::Packet>(inet->createPacket(TCP::Packet::HEADERS_SIZE));
+  packet->init();
+  packet->set_source(from);
+  packet->set_destination({inet->ip_addr(), LOCAL_PORT});
+  packet->set_seq(seq).set_ack(ack).set_flags(flags);
+  packet->set_checksum(TCP::checksum(packet));
+  return packet;
+}
+
+// A peer in the service itself: what the stack sends never leaves,
+// and every SYN-ACK is answered with the ACK completing the handshake
+static void loopback(net::Packet_ptr out) {
+  auto synack = std::static_pointer_cast<TCP::Packet>(out);
+  if(synack->isset(TCP::SYN) and synack->isset(TCP::ACK))
+    reply = segment(synack->destination(), synack->ack(), synack->seq() + 1, TCP::ACK);
+}
+
+static void handshake(TCP& tcp, size_t i) {
+  tcp.bottom(segment(peer(i), PEER_ISS, 0, TCP::SYN));
+  if(reply)
+    tcp.bottom(std::move(reply));
+}
+
+void Service::start()
+{
+  hw::Nic<VirtioNet>& eth0 = hw::Dev::eth<0,VirtioNet>();
+  inet = std::make_unique<Inet4<VirtioNet>>(eth0);
+  inet->network_config( {  10,  0,  0, 42 },  // IP
+                        {  255,255,255, 0 },  // Netmask
+                        {  10,  0,  0,  1 },  // Gateway
+                        {   8,  8,  8,  8 } );// DNS
+  inet->ip_obj().set_linklayer_out(loopback);
+  auto& tcp = inet->tcp();
+
+  INFO("Idle", "sizeof(TCP::Connection) is %u bytes", sizeof(TCP::Connection));
+
+  tcp.bind(LOCAL_PORT).onConnect([](TCP::Connection_ptr) { established++; });
+
+  // Idle: established, nothing to read, nothing to write.
+  // Only the stack holds on to them.
+  auto before = heap_used();
+  auto t0 = OS::cycles_since_boot();
+  for (size_t i = 0; i < CONNECTIONS - MEASURED; i++)
+    handshake(tcp, i);
+
+  const auto mark = heap_used();
+  for (size_t i = CONNECTIONS - MEASURED; i < CONNECTIONS; i++)
+    handshake(tcp, i);
+  auto t1 = OS::cycles_since_boot();
+
+  CHECKSERT(established == CONNECTIONS and tcp.activeConnections() == CONNECTIONS,
+            "%u connections established", established);
+
+  // the connection with its congestion control, and anything else it allocates
+  const auto idle = (heap_used() - mark) / MEASURED;
+  // and with the stack's connection table
+  const auto total = (heap_used() - before) / CONNECTIONS;
+
+  INFO2("Idle:    %u bytes/conn on the heap, %u with the connection table",
+        idle, total);
+  INFO2("Open:    %llu cycles/conn for the handshake", (t1 - t0) / CONNECTIONS);
+
+  CHECKSERT(idle < 256, "An idle connection takes less than 256 bytes (%u)", idle);
+
+  // Gone again: the peer resets every one
+  before = heap_used();
+  for (size_t i = 0; i < CONNECTIONS; i++)
+    tcp.bottom(segment(peer(i), PEER_ISS + 1, 0, TCP::RST));
+  INFO2("Freed:   %u MB", (before - heap_used()) >> 20);
+
+  CHECKSERT(tcp.activeConnections() == 0, "Everything was released");
+
+  INFO("Idle", "SUCCESS");
+}
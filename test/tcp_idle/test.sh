@@ -0,0 +1,8 @@
+#!/bin/bash
+source ../test_base
+
+# a million connections don't fit in the default 128 MB
+export MEM="-m 1024"
+
+make
+start test_tcp_idle.img "TCP idle connections benchmark"
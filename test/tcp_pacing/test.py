@@ -0,0 +1,40 @@
+#!/usr/bin/python
+
+import os
+import re
+import subprocess
+import sys
+sys.path.insert(0,"..")
+
+import vmrunner
+import tcp_bulk
+
+# Usage: python test.py $GUEST_IP
+GUEST = '10.0.0.42' if (len(sys.argv) < 2) else sys.argv[1]
+# A shallow bottleneck queue, so bursts overflow it
+NETEM = os.environ.get("NETEM", "delay 20ms rate 20mbit limit 20")
+
+def qdisc_stats():
+    out = subprocess.check_output(["tc", "-s", "qdisc", "show", "dev", "ifb0"])
+    sent = re.search(r"Sent \d+ bytes (\d+) pkt \(dropped (\d+)", out)
+    return int(sent.group(1)), int(sent.group(2))
+
+def transfer(name, port):
+    sent_before, dropped_before = qdisc_stats()
+    received, elapsed = tcp_bulk.receive(GUEST, port)
+    sent, dropped = qdisc_stats()
+    sent -= sent_before
+    dropped -= dropped_before
+    loss = 100.0 * dropped / (sent + dropped) if sent + dropped else 0
+    print "%-6s %8.1f KB/s   %6d packets dropped at the bottleneck (%.2f%%)" % (
+        name, received / elapsed / 1024, dropped, loss)
+
+def benchmark():
+    def run():
+        transfer("burst", 8001)
+        transfer("paced", 8002)
+    tcp_bulk.with_netem(NETEM, run)
+
+vm = vmrunner.vms[0]
+vm.on_output("Benchmark ready", benchmark)
+vm.boot(300)
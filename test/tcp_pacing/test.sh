@@ -0,0 +1,4 @@
+#!/bin/bash
+# NETEM overrides the impairment, e.g. NETEM="delay 50ms rate 10mbit limit 10" ./test.sh
+make
+python test.py